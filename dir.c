@@ -5,55 +5,70 @@
 
 /**
  * Function: osfs_lookup
- * Description: Looks up a file within a directory.
+ * Description: Looks up a file within a directory. The name is resolved
+ *              through the directory index, which is read under RCU only, so
+ *              lookups never wait for creates in the same directory. Neither
+ *              step depends on the dcache: the index holds every name, and
+ *              the inode of a pruned dentry is usually still in the inode
+ *              cache, so a cold walk costs one index probe and one inode
+ *              hash lookup per component.
  * Inputs:
  *   - dir: The inode of the directory to search in.
  *   - dentry: The dentry representing the file to look up.
  *   - flags: Flags for the lookup operation.
  * Returns:
  *   - A pointer to the dentry if the file is found.
- *   - NULL if the file is not found, allowing the VFS to handle it.
+ *   - NULL if the file is not found; dentry is then a hashed negative dentry.
  */
 static struct dentry *osfs_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 {
     struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
-    struct osfs_inode *parent_inode = dir->i_private;
-    void *dir_data_block;
-    struct osfs_dir_entry *dir_entries;
-    int dir_entry_count;
-    int i;
     struct inode *inode = NULL;
-
-    pr_info("osfs_lookup: Looking up '%.*s' in inode %lu\n",
-            (int)dentry->d_name.len, dentry->d_name.name, dir->i_ino);
-
-    // Read the parent directory's data block
-    dir_data_block = sb_info->data_blocks + parent_inode->i_block * BLOCK_SIZE;
-
-    // Calculate the number of directory entries
-    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
-
-    // Traverse the directory entries to find a matching filename
-    for (i = 0; i < dir_entry_count; i++) {
-        if (strlen(dir_entries[i].filename) == dentry->d_name.len &&
-            strncmp(dir_entries[i].filename, dentry->d_name.name, dentry->d_name.len) == 0) {
-            // File found, get inode
-            inode = osfs_iget(dir->i_sb, dir_entries[i].inode_no);
-            if (IS_ERR(inode)) {
-                pr_err("osfs_lookup: Error getting inode %u\n", dir_entries[i].inode_no);
-                return ERR_CAST(inode);
-            }
-            return d_splice_alias(inode, dentry);
+    uint32_t ino;
+
+    ino = osfs_dindex_lookup(sb_info, dir->i_ino, dentry->d_name.name, dentry->d_name.len);
+    if (ino) {
+        inode = osfs_iget(dir->i_sb, ino);
+        if (IS_ERR(inode)) {
+            pr_err("osfs_lookup: Error getting inode %u\n", ino);
+            return ERR_CAST(inode);
         }
+        osfs_trace(dir->i_sb, OSFS_TRACE_LOOKUP, inode, dir, &dentry->d_name, 0, 0, 0);
+        return d_splice_alias(inode, dentry);
     }
 
+    osfs_trace(dir->i_sb, OSFS_TRACE_LOOKUP, NULL, dir, &dentry->d_name, 0, 0, -ENOENT);
+    // Hash a negative dentry so repeated misses are answered by the dcache;
+    // osfs_create/osfs_mkdir turn it positive with d_instantiate()
+    d_add(dentry, NULL);
     return NULL;
 }
 
+/**
+ * Function: osfs_dir_entries
+ * Description: Returns the dirent array stored in a directory's data block.
+ */
+static inline struct osfs_dir_entry *osfs_dir_entries(struct osfs_sb_info *sb_info, struct osfs_inode *dir_inode)
+{
+    return (struct osfs_dir_entry *)osfs_block_addr(sb_info, dir_inode->i_block);
+}
+
+/**
+ * Function: osfs_sync_links
+ * Description: Copies the VFS link count into the osfs_inode.
+ */
+static inline void osfs_sync_links(struct inode *inode)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    osfs_inode->i_links_count = inode->i_nlink;
+}
+
 /**
  * Function: osfs_iterate
- * Description: Iterates over the entries in a directory.
+ * Description: Iterates over the entries in a directory. Slots below i_size
+ *              may be free (removed entries) or still being filled in by an
+ *              appender; both are skipped.
  * Inputs:
  *   - filp: The file pointer representing the directory.
  *   - ctx: The directory context used for iteration.
@@ -66,7 +81,6 @@ static int osfs_iterate(struct file *filp, struct dir_context *ctx)
     struct inode *inode = file_inode(filp);
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
     struct osfs_inode *osfs_inode = inode->i_private;
-    void *dir_data_block;
     struct osfs_dir_entry *dir_entries;
     int dir_entry_count;
     int i;
@@ -76,9 +90,8 @@ static int osfs_iterate(struct file *filp, struct dir_context *ctx)
             return 0;
     }
 
-    dir_data_block = sb_info->data_blocks + osfs_inode->i_block * BLOCK_SIZE;
-    dir_entry_count = osfs_inode->i_size / sizeof(struct osfs_dir_entry);
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
+    dir_entries = osfs_dir_entries(sb_info, osfs_inode);
+    dir_entry_count = smp_load_acquire(&osfs_inode->i_size) / sizeof(struct osfs_dir_entry);
 
     /* Adjust the index based on ctx->pos */
     i = ctx->pos - 2;
@@ -86,19 +99,39 @@ static int osfs_iterate(struct file *filp, struct dir_context *ctx)
     for (; i < dir_entry_count; i++) {
         struct osfs_dir_entry *entry = &dir_entries[i];
         unsigned int type = DT_UNKNOWN;
+        // Pairs with the release in osfs_add_dir_entry: a live inode number means a complete name
+        uint32_t ino = smp_load_acquire(&entry->inode_no);
 
-        pr_info("osfs_iterate: Entry %d: '%s' (inode %u)\n", i, entry->filename, entry->inode_no);
-        if (!dir_emit(ctx, entry->filename, strlen(entry->filename), entry->inode_no, type)) {
-            pr_err("osfs_iterate: dir_emit failed for entry '%s'\n", entry->filename);
-            return -EINVAL;
+        if (ino) {
+            if (!dir_emit(ctx, entry->filename, strlen(entry->filename), ino, type))
+                return 0;
         }
 
-        ctx->pos++;
+        ctx->pos = i + 3;
     }
 
     return 0;
 }
 
+/**
+ * Function: osfs_dir_is_empty
+ * Description: Checks whether a directory has no entries besides . and ..
+ */
+static bool osfs_dir_is_empty(struct inode *dir)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = dir->i_private;
+    struct osfs_dir_entry *dir_entries = osfs_dir_entries(sb_info, osfs_inode);
+    int dir_entry_count = smp_load_acquire(&osfs_inode->i_size) / sizeof(struct osfs_dir_entry);
+    int i;
+
+    for (i = 0; i < dir_entry_count; i++) {
+        if (READ_ONCE(dir_entries[i].inode_no))
+            return false;
+    }
+    return true;
+}
+
 /**
  * Function: osfs_new_inode
  * Description: Creates a new inode within the filesystem.
@@ -118,6 +151,7 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     struct osfs_sb_info *sb_info = sb->s_fs_info;
     struct inode *inode;
     struct osfs_inode *osfs_inode;
+    uint32_t ino_goal, block_goal;
     int ino, ret;
 
     /* Check if the mode is supported */
@@ -127,23 +161,34 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     }
 
     /* Check if there are free inodes and blocks */
-    if (sb_info->nr_free_inodes == 0 || sb_info->nr_free_blocks == 0)
+    if (atomic_read(&sb_info->nr_free_inodes) == 0 || atomic_read(&sb_info->nr_free_blocks) == 0)
         return ERR_PTR(-ENOSPC);
 
-    /* Allocate a new inode number */
-    ino = osfs_get_free_inode(sb_info);
+    /* Allocate a new inode number, near the parent or in a new region */
+    ino_goal = osfs_place_inode(sb_info, dir, mode, &block_goal);
+    ino = osfs_get_free_inode(sb_info, ino_goal);
     if (ino < 0 || ino >= sb_info->inode_count)
         return ERR_PTR(-ENOSPC);
 
     /* Allocate a new VFS inode */
     inode = new_inode(sb);
-    if (!inode)
+    if (!inode) {
+        osfs_put_free_inode(sb_info, ino);
         return ERR_PTR(-ENOMEM);
+    }
 
     /* Initialize inode owner and permissions */
     inode_init_owner(&nop_mnt_idmap, inode, dir, mode);
     inode->i_ino = ino;
     inode->i_sb = sb;
+    // Hashed so osfs_iget finds it, but I_NEW until it is set up below:
+    // a lookup such as the log cleaner's waits in iget_locked()
+    if (insert_inode_locked(inode) < 0) {
+        // The number is in use by a cached inode; the bitmap is corrupt
+        pr_err("osfs_new_inode: Inode %d is already in use\n", ino);
+        iput(inode);
+        return ERR_PTR(-EIO);
+    }
     inode->i_blocks = 0;
     simple_inode_init_ts(inode);
 
@@ -156,6 +201,8 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     } else if (S_ISREG(mode)) {
         inode->i_op = &osfs_file_inode_operations;
         inode->i_fop = &osfs_file_operations;
+        inode->i_mapping->a_ops = &osfs_aops;
+        mapping_set_large_folios(inode->i_mapping);
         set_nlink(inode, 1);
         inode->i_size = 0;
     } else if (S_ISLNK(mode)) {
@@ -168,7 +215,8 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     osfs_inode = osfs_get_osfs_inode(sb, ino);
     if (!osfs_inode) {
         pr_err("osfs_new_inode: Failed to get osfs_inode for inode %d\n", ino);
-        iput(inode);
+        discard_new_inode(inode);
+        osfs_put_free_inode(sb_info, ino);
         return ERR_PTR(-EIO);
     }
     memset(osfs_inode, 0, sizeof(*osfs_inode));
@@ -179,6 +227,11 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     osfs_inode->i_uid = i_uid_read(inode);
     osfs_inode->i_gid = i_gid_read(inode);
     osfs_inode->i_size = inode->i_size;
+    osfs_inode->i_links_count = inode->i_nlink;
+    osfs_inode->i_xattr_block = OSFS_NO_BLOCK;
+    osfs_inode->i_generation = atomic_inc_return(&sb_info->next_generation);
+    osfs_inode->i_parent = dir->i_ino;
+    inode->i_generation = osfs_inode->i_generation;
     osfs_inode->i_blocks = 0; // Simplified handling
     osfs_inode->__i_atime = osfs_inode->__i_mtime = osfs_inode->__i_ctime = current_time(inode);
     inode->i_private = osfs_inode;
@@ -186,65 +239,160 @@ struct inode *osfs_new_inode(const struct inode *dir, umode_t mode)
     /* Allocate data block only if folder and link type */
     if(!S_ISREG(mode))
     {
-        ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_block);
+        ret = osfs_alloc_data_block_near(sb_info, block_goal, &osfs_inode->i_block);
         if (ret) {
             pr_err("osfs_new_inode: Failed to allocate data block\n");
-            iput(inode);
+            clear_nlink(inode); // let eviction release the inode number
+            discard_new_inode(inode);
             return ERR_PTR(ret);
         }
+        if (S_ISDIR(mode))
+            osfs_place_dir_added(sb_info, osfs_inode->i_block);
         osfs_inode->i_blocks = 1;
+        inode->i_blocks = osfs_vfs_blocks(1);
+        // Free dirent slots read as inode 0
+        memset(osfs_block_addr(sb_info, osfs_inode->i_block), 0, BLOCK_SIZE);
     }
 
-    /* Update superblock information */
-    sb_info->nr_free_inodes--;
-
     /* Mark inode as dirty */
     mark_inode_dirty(inode);
+    unlock_new_inode(inode);
 
     return inode;
 }
 
+/**
+ * Function: osfs_add_dir_entry
+ * Description: Adds an entry to a directory. Callers hold the directory's
+ *              i_rwsem exclusively, as the VFS does for create, mkdir, link
+ *              and rename, so adds and removals in one directory are
+ *              serialized. Readers are not: the name is claimed in the
+ *              directory index (bucket lock) for lookups, and the entry goes
+ *              live when its inode number is stored with release semantics.
+ *              i_size is the high-water mark of used slots.
+ * Inputs:
+ *   - dir: The inode of the parent directory.
+ *   - inode_no: The inode number of the new entry.
+ *   - name, name_len: The name of the new entry.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if the parent directory is full.
+ *   - -EEXIST if the name already exists.
+ *   - -ENOMEM if the index entry cannot be allocated.
+ */
 static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *name, size_t name_len)
 {
     struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
     struct osfs_inode *parent_inode = dir->i_private;
-    void *dir_data_block;
+    struct osfs_dindex_entry *index_entry;
     struct osfs_dir_entry *dir_entries;
-    int dir_entry_count;
-    int i;
+    uint32_t slot;
+    uint64_t end;
 
-    pr_info("osfs_add_dir_entry: Adding entry '%.*s' to inode %lu\n", (int)name_len, name, dir->i_ino);
-    // Read the parent directory's data block
-    dir_data_block = sb_info->data_blocks + parent_inode->i_block * BLOCK_SIZE;
+    pr_debug("osfs_add_dir_entry: Adding entry '%.*s' to inode %lu\n", (int)name_len, name, dir->i_ino);
 
-    // Calculate the existing number of directory entries
-    dir_entry_count = parent_inode->i_size / sizeof(struct osfs_dir_entry);
-    pr_info("osfs_add_dir_entry: Directory has %d entries\n", dir_entry_count);
-    if (dir_entry_count >= MAX_DIR_ENTRIES) {
+    // Claim the name first; this doubles as the duplicate check
+    index_entry = osfs_dindex_insert(sb_info, dir->i_ino, name, name_len, inode_no);
+    if (IS_ERR(index_entry)) {
+        if (PTR_ERR(index_entry) == -EEXIST)
+            pr_warn("osfs_add_dir_entry: File '%.*s' already exists\n", (int)name_len, name);
+        return PTR_ERR(index_entry);
+    }
+
+    // Take the first free slot, reusing those left by removed entries
+    dir_entries = osfs_dir_entries(sb_info, parent_inode);
+    for (slot = 0; slot < MAX_DIR_ENTRIES; slot++) {
+        if (!dir_entries[slot].inode_no)
+            break;
+    }
+    if (slot >= MAX_DIR_ENTRIES) {
         pr_err("osfs_add_dir_entry: Parent directory is full\n");
+        osfs_dindex_remove(sb_info, index_entry);
         return -ENOSPC;
     }
+    osfs_dindex_set_slot(index_entry, slot);
 
-    dir_entries = (struct osfs_dir_entry *)dir_data_block;
+    strncpy(dir_entries[slot].filename, name, name_len);
+    dir_entries[slot].filename[name_len] = '\0';
+    smp_store_release(&dir_entries[slot].inode_no, inode_no);
 
-    // Check if a file with the same name exists
-    for (i = 0; i < dir_entry_count; i++) {
-        if (strlen(dir_entries[i].filename) == name_len &&
-            strncmp(dir_entries[i].filename, name, name_len) == 0) {
-            pr_warn("osfs_add_dir_entry: File '%.*s' already exists\n", (int)name_len, name);
-            return -EEXIST;
-        }
-    }
-    pr_info("osfs_add_dir_entry: Adding entry '%.*s' to inode %lu at position %d\n", (int)name_len, name, dir->i_ino, dir_entry_count);
+    // Raise the high-water mark so readdir covers the slot
+    end = (slot + 1) * sizeof(struct osfs_dir_entry);
+    if (parent_inode->i_size < end)
+        smp_store_release(&parent_inode->i_size, end);
 
-    // Append a new directory entry
-    strncpy(dir_entries[dir_entry_count].filename, name, name_len);
-    dir_entries[dir_entry_count].filename[name_len] = '\0';
-    dir_entries[dir_entry_count].inode_no = inode_no;
+    pr_debug("osfs_add_dir_entry: Added entry '%.*s' to inode %lu at position %u\n",
+             (int)name_len, name, dir->i_ino, slot);
+    return 0;
+}
 
-    // Update the size of the parent directory
-    parent_inode->i_size += sizeof(struct osfs_dir_entry);
+/**
+ * Function: osfs_remove_dir_entry
+ * Description: Removes an entry from a directory by freeing its slot in
+ *              place, then drops free slots from the end of the high-water
+ *              mark. Callers hold the directory's i_rwsem exclusively.
+ * Inputs:
+ *   - dir: The inode of the parent directory.
+ *   - index_entry: The index entry of the name being removed.
+ * Returns:
+ *   - None.
+ */
+static void osfs_remove_dir_entry(struct inode *dir, struct osfs_dindex_entry *index_entry)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_inode *parent_inode = dir->i_private;
+    struct osfs_dir_entry *dir_entries = osfs_dir_entries(sb_info, parent_inode);
+    uint32_t slot = index_entry->slot;
+    uint32_t trimmed;
+
+    osfs_dindex_remove(sb_info, index_entry);
+    dir_entries[slot].filename[0] = '\0';
+    WRITE_ONCE(dir_entries[slot].inode_no, 0);
+
+    // No add can run meanwhile, so the free tail is stable
+    trimmed = parent_inode->i_size / sizeof(struct osfs_dir_entry);
+    while (trimmed > 0 && !dir_entries[trimmed - 1].inode_no)
+        trimmed--;
+    WRITE_ONCE(parent_inode->i_size, trimmed * sizeof(struct osfs_dir_entry));
+}
+
+/**
+ * Function: osfs_set_dir_entry_ino
+ * Description: Repoints an existing entry at another inode in place.
+ */
+static void osfs_set_dir_entry_ino(struct inode *dir, struct osfs_dindex_entry *index_entry, uint32_t ino)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_dir_entry *dir_entries = osfs_dir_entries(sb_info, dir->i_private);
 
+    WRITE_ONCE(dir_entries[index_entry->slot].inode_no, ino);
+    osfs_dindex_set_ino(index_entry, ino);
+}
+
+/**
+ * Function: osfs_rename_dir_entry
+ * Description: Renames an entry within its directory by rewriting the name
+ *              in its slot; the new name is claimed in the index first.
+ * Returns:
+ *   - 0 on success.
+ *   - -EEXIST or -ENOMEM from the index insert.
+ */
+static int osfs_rename_dir_entry(struct inode *dir, struct osfs_dindex_entry *index_entry,
+                                 const char *name, size_t name_len)
+{
+    struct osfs_sb_info *sb_info = dir->i_sb->s_fs_info;
+    struct osfs_dir_entry *dir_entries = osfs_dir_entries(sb_info, dir->i_private);
+    struct osfs_dindex_entry *new_entry;
+    uint32_t slot = index_entry->slot;
+
+    new_entry = osfs_dindex_insert(sb_info, dir->i_ino, name, name_len, index_entry->ino);
+    if (IS_ERR(new_entry))
+        return PTR_ERR(new_entry);
+    osfs_dindex_set_slot(new_entry, slot);
+
+    memcpy(dir_entries[slot].filename, name, name_len);
+    dir_entries[slot].filename[name_len] = '\0';
+    osfs_dindex_remove(sb_info, index_entry);
     return 0;
 }
 
@@ -268,15 +416,14 @@ static int osfs_add_dir_entry(struct inode *dir, uint32_t inode_no, const char *
 static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry *dentry, umode_t mode, bool excl)
 {   
     // Step1: Parse the parent directory passed by the VFS 
-    struct osfs_inode *parent_inode = dir->i_private;
     struct osfs_inode *osfs_inode;
     struct inode *inode;
     int ret;
 
-    pr_info("osfs_create: Create a new file\n");
+    pr_debug("osfs_create: Create a new file\n");
 
     // Step2: Validate the file name length
-    if(dentry->d_name.len > MAX_FILENAME_LEN) {
+    if(dentry->d_name.len >= MAX_FILENAME_LEN) {
         pr_err("osfs_create: File name too long\n");
         return -ENAMETOOLONG;
     }
@@ -284,7 +431,10 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
 
     // Step3: Allocate and initialize VFS & osfs inode
     inode = osfs_new_inode(dir, mode);
-    
+    if (IS_ERR(inode)) {
+        pr_err("osfs_create: Failed to allocate inode\n");
+        return PTR_ERR(inode);
+    }
 
     osfs_inode = inode->i_private;
     if (!osfs_inode) {
@@ -300,38 +450,45 @@ static int osfs_create(struct mnt_idmap *idmap, struct inode *dir, struct dentry
 
     if (ret) {
         pr_err("osfs_create: Failed to add directory entry\n");
+        osfs_trace(dir->i_sb, OSFS_TRACE_CREATE, NULL, dir, &dentry->d_name, 0, 0, ret);
+        clear_nlink(inode); // let eviction release the inode number
         iput(inode);
         return ret;
     }
 
     // Step 5: Update the parent directory's metadata 
-    dir->__i_mtime = parent_inode->__i_mtime = current_time(dir);
+    inode_set_mtime_to_ts(dir, inode_set_ctime_current(dir));
+    inode_maybe_inc_iversion(dir, false);
     mark_inode_dirty(dir);
     
     // Step 6: Bind the inode to the VFS dentry
     d_instantiate(dentry, inode);
 
-    pr_info("osfs_create: File '%.*s' created with inode %lu\n",
-            (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
+    osfs_trace(dir->i_sb, OSFS_TRACE_CREATE, inode, dir, &dentry->d_name, 0, 0, 0);
+    pr_debug("osfs_create: File '%.*s' created with inode %lu\n",
+             (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
 
     return 0;
 }
 
 static int osfs_mkdir(struct mnt_idmap *idmap, struct inode *dir, struct dentry *dentry, umode_t mode)
 {
-    struct osfs_inode *parent_inode = dir->i_private;
     struct osfs_inode *osfs_inode;
     struct inode *inode;
     int ret;
 
-    pr_info("osfs_mkdir: Create a new directory\n");
+    pr_debug("osfs_mkdir: Create a new directory\n");
 
-    if (dentry->d_name.len > MAX_FILENAME_LEN) {
+    if (dentry->d_name.len >= MAX_FILENAME_LEN) {
         pr_err("osfs_mkdir: Directory name too long\n");
         return -ENAMETOOLONG;
     }
 
     inode = osfs_new_inode(dir, S_IFDIR | mode);
+    if (IS_ERR(inode)) {
+        pr_err("osfs_mkdir: Failed to allocate inode\n");
+        return PTR_ERR(inode);
+    }
     osfs_inode = inode->i_private;
     if (!osfs_inode) {
         pr_err("osfs_mkdir: Failed to get osfs_inode for inode %lu\n", inode->i_ino);
@@ -343,29 +500,309 @@ static int osfs_mkdir(struct mnt_idmap *idmap, struct inode *dir, struct dentry
     ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
     if (ret) {
         pr_err("osfs_mkdir: Failed to add directory entry\n");
+        osfs_trace(dir->i_sb, OSFS_TRACE_MKDIR, NULL, dir, &dentry->d_name, 0, 0, ret);
+        clear_nlink(inode); // let eviction release the inode and its block
         iput(inode);
         return ret;
     }
 
-    dir->__i_mtime = parent_inode->__i_mtime = current_time(dir);
+    // The new directory's ".." links to the parent
+    inc_nlink(dir);
+    osfs_sync_links(dir);
+    inode_set_mtime_to_ts(dir, inode_set_ctime_current(dir));
+    inode_maybe_inc_iversion(dir, false);
+    mark_inode_dirty(dir);
+
+    d_instantiate(dentry, inode);
+
+    osfs_trace(dir->i_sb, OSFS_TRACE_MKDIR, inode, dir, &dentry->d_name, 0, 0, 0);
+    pr_debug("osfs_mkdir: Directory '%.*s' created with inode %lu\n",
+             (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
+
+    return 0;
+}
+
+/**
+ * Function: osfs_find_dir_entry
+ * Description: Resolves a dentry's name to its index entry. The caller
+ *              holds the parent's i_rwsem, so the entry cannot go away.
+ */
+static struct osfs_dindex_entry *osfs_find_dir_entry(struct inode *dir, struct dentry *dentry)
+{
+    struct osfs_dindex_entry *e;
+
+    rcu_read_lock();
+    e = osfs_dindex_find(dir->i_sb->s_fs_info, dir->i_ino, dentry->d_name.name, dentry->d_name.len);
+    rcu_read_unlock();
+    return e;
+}
+
+/**
+ * Function: __osfs_rename
+ * Description: Renames a file or directory. Only dirents and the directory
+ *              index are touched, never data blocks: both names are resolved
+ *              through the index in O(1), a same-directory rename rewrites
+ *              the name in its slot, a rename over an existing target
+ *              repoints the target's dirent, and RENAME_EXCHANGE swaps the
+ *              inode numbers of the two dirents.
+ * Inputs:
+ *   - old_dir, old_dentry: The source directory and entry.
+ *   - new_dir, new_dentry: The target directory and entry.
+ *   - flags: RENAME_NOREPLACE and/or RENAME_EXCHANGE.
+ * Returns:
+ *   - 0 on success.
+ *   - -EINVAL for unsupported flags.
+ *   - -ENAMETOOLONG if the new name is too long.
+ *   - -ENOTEMPTY if the target is a non-empty directory.
+ *   - -ENOSPC or -ENOMEM if the target directory cannot take the entry.
+ */
+static int __osfs_rename(struct inode *old_dir, struct dentry *old_dentry,
+                         struct inode *new_dir, struct dentry *new_dentry, unsigned int flags)
+{
+    struct inode *old_inode = d_inode(old_dentry);
+    struct inode *new_inode = d_inode(new_dentry);
+    struct osfs_dindex_entry *old_entry, *new_entry = NULL;
+    bool they_are_dirs = S_ISDIR(old_inode->i_mode);
+    struct timespec64 now;
+    int ret;
+
+    // RENAME_NOREPLACE needs no work here: the VFS already failed it if the target exists
+    if (flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE))
+        return -EINVAL;
+    if (new_dentry->d_name.len >= MAX_FILENAME_LEN)
+        return -ENAMETOOLONG;
+
+    old_entry = osfs_find_dir_entry(old_dir, old_dentry);
+    if (new_inode)
+        new_entry = osfs_find_dir_entry(new_dir, new_dentry);
+    if (!old_entry || (new_inode && !new_entry)) {
+        pr_err("osfs_rename: Directory index out of sync with the dcache\n");
+        return -EIO;
+    }
+
+    if (flags & RENAME_EXCHANGE) {
+        osfs_set_dir_entry_ino(old_dir, old_entry, new_inode->i_ino);
+        osfs_set_dir_entry_ino(new_dir, new_entry, old_inode->i_ino);
+        if (old_dir != new_dir && they_are_dirs != S_ISDIR(new_inode->i_mode)) {
+            // A subdirectory moves from one parent to the other
+            if (they_are_dirs) {
+                drop_nlink(old_dir);
+                inc_nlink(new_dir);
+            } else {
+                inc_nlink(old_dir);
+                drop_nlink(new_dir);
+            }
+        }
+    } else if (new_inode) {
+        if (S_ISDIR(new_inode->i_mode) && !osfs_dir_is_empty(new_inode))
+            return -ENOTEMPTY;
+        osfs_set_dir_entry_ino(new_dir, new_entry, old_inode->i_ino);
+        osfs_remove_dir_entry(old_dir, old_entry);
+        if (they_are_dirs) {
+            drop_nlink(new_inode);
+            drop_nlink(old_dir);
+        }
+        drop_nlink(new_inode);
+    } else {
+        if (old_dir == new_dir)
+            ret = osfs_rename_dir_entry(old_dir, old_entry, new_dentry->d_name.name, new_dentry->d_name.len);
+        else
+            ret = osfs_add_dir_entry(new_dir, old_inode->i_ino, new_dentry->d_name.name, new_dentry->d_name.len);
+        if (ret)
+            return ret;
+        if (old_dir != new_dir)
+            osfs_remove_dir_entry(old_dir, old_entry);
+        if (they_are_dirs) {
+            drop_nlink(old_dir);
+            inc_nlink(new_dir);
+        }
+    }
+
+    // Moved directories follow their new parent for osfs_get_parent
+    if (old_dir != new_dir) {
+        if (they_are_dirs)
+            WRITE_ONCE(((struct osfs_inode *)old_inode->i_private)->i_parent, new_dir->i_ino);
+        if ((flags & RENAME_EXCHANGE) && S_ISDIR(new_inode->i_mode))
+            WRITE_ONCE(((struct osfs_inode *)new_inode->i_private)->i_parent, old_dir->i_ino);
+    }
+
+    now = current_time(old_dir);
+    inode_set_mtime_to_ts(old_dir, now);
+    inode_set_mtime_to_ts(new_dir, now);
+    inode_set_ctime_to_ts(old_dir, now);
+    inode_set_ctime_to_ts(new_dir, now);
+    inode_set_ctime_to_ts(old_inode, now);
+    osfs_sync_links(old_dir);
+    osfs_sync_links(new_dir);
+    inode_maybe_inc_iversion(old_dir, false);
+    inode_maybe_inc_iversion(new_dir, false);
+    inode_maybe_inc_iversion(old_inode, false);
+    if (new_inode) {
+        inode_set_ctime_to_ts(new_inode, now);
+        inode_maybe_inc_iversion(new_inode, false);
+        osfs_sync_links(new_inode);
+    }
+    mark_inode_dirty(old_dir);
+    mark_inode_dirty(new_dir);
+
+    return 0;
+}
+
+/**
+ * Function: osfs_rename
+ * Description: The .rename operation: __osfs_rename() plus its trace record,
+ *              taken before the VFS moves the dentries.
+ */
+static int osfs_rename(struct mnt_idmap *idmap, struct inode *old_dir, struct dentry *old_dentry,
+                       struct inode *new_dir, struct dentry *new_dentry, unsigned int flags)
+{
+    int ret = __osfs_rename(old_dir, old_dentry, new_dir, new_dentry, flags);
+
+    osfs_trace_rename(old_dir, old_dentry, new_dir, new_dentry, flags, ret);
+    return ret;
+}
+
+/**
+ * Function: osfs_link
+ * Description: Creates a hard link: a new dirent pointing at the existing
+ *              inode. No data is copied.
+ * Inputs:
+ *   - old_dentry: The existing file.
+ *   - dir: The directory to create the link in.
+ *   - dentry: The new name.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENAMETOOLONG, -EEXIST, -ENOSPC or -ENOMEM on failure.
+ */
+static int osfs_link(struct dentry *old_dentry, struct inode *dir, struct dentry *dentry)
+{
+    struct inode *inode = d_inode(old_dentry);
+    struct timespec64 now;
+    int ret;
+
+    if (dentry->d_name.len >= MAX_FILENAME_LEN)
+        ret = -ENAMETOOLONG;
+    else
+        ret = osfs_add_dir_entry(dir, inode->i_ino, dentry->d_name.name, dentry->d_name.len);
+    if (ret) {
+        osfs_trace(dir->i_sb, OSFS_TRACE_LINK, inode, dir, &dentry->d_name, 0, 0, ret);
+        return ret;
+    }
+
+    now = current_time(inode);
+    inode_set_ctime_to_ts(inode, now);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    inode_maybe_inc_iversion(inode, false);
+    inode_maybe_inc_iversion(dir, false);
+    inc_nlink(inode);
+    osfs_sync_links(inode);
+    mark_inode_dirty(inode);
+    mark_inode_dirty(dir);
 
+    ihold(inode);
     d_instantiate(dentry, inode);
+    osfs_trace(dir->i_sb, OSFS_TRACE_LINK, inode, dir, &dentry->d_name, 0, 0, 0);
+    return 0;
+}
 
-    pr_info("osfs_mkdir: Directory '%.*s' created with inode %lu\n",
-            (int)dentry->d_name.len, dentry->d_name.name, inode->i_ino);
+/**
+ * Function: osfs_remove_name
+ * Description: Removes a name. The inode and its data are released by
+ *              osfs_evict_inode once the last link and the last open
+ *              reference are both gone.
+ * Inputs:
+ *   - dir: The parent directory.
+ *   - dentry: The name to remove.
+ * Returns:
+ *   - 0 on success.
+ *   - -EIO if the directory index does not know the name.
+ */
+static int osfs_remove_name(struct inode *dir, struct dentry *dentry)
+{
+    struct inode *inode = d_inode(dentry);
+    struct osfs_dindex_entry *entry;
+    struct timespec64 now;
 
+    entry = osfs_find_dir_entry(dir, dentry);
+    if (!entry) {
+        pr_err("osfs_remove_name: Directory index out of sync with the dcache\n");
+        return -EIO;
+    }
+    osfs_remove_dir_entry(dir, entry);
+
+    now = current_time(inode);
+    inode_set_ctime_to_ts(inode, now);
+    inode_set_mtime_to_ts(dir, now);
+    inode_set_ctime_to_ts(dir, now);
+    inode_maybe_inc_iversion(inode, false);
+    inode_maybe_inc_iversion(dir, false);
+    drop_nlink(inode);
+    osfs_sync_links(inode);
+    mark_inode_dirty(inode);
+    mark_inode_dirty(dir);
     return 0;
 }
 
+/**
+ * Function: osfs_unlink
+ * Description: The .unlink operation: osfs_remove_name() plus its trace
+ *              record.
+ */
+static int osfs_unlink(struct inode *dir, struct dentry *dentry)
+{
+    int ret = osfs_remove_name(dir, dentry);
+
+    osfs_trace(dir->i_sb, OSFS_TRACE_UNLINK, d_inode(dentry), dir, &dentry->d_name, 0, 0, ret);
+    return ret;
+}
+
+/**
+ * Function: osfs_rmdir
+ * Description: Removes an empty directory.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOTEMPTY if the directory still has entries.
+ */
+static int osfs_rmdir(struct inode *dir, struct dentry *dentry)
+{
+    struct inode *inode = d_inode(dentry);
+    int ret;
+
+    if (!osfs_dir_is_empty(inode))
+        ret = -ENOTEMPTY;
+    else
+        ret = osfs_remove_name(dir, dentry);
+    if (!ret) {
+        // Drop the "." link and the parent's ".." link
+        drop_nlink(inode);
+        osfs_sync_links(inode);
+        drop_nlink(dir);
+        osfs_sync_links(dir);
+    }
+    osfs_trace(dir->i_sb, OSFS_TRACE_RMDIR, inode, dir, &dentry->d_name, 0, 0, ret);
+    return ret;
+}
+
 const struct inode_operations osfs_dir_inode_operations = {
     .lookup = osfs_lookup,
     .create = osfs_create,
     // Add other operations as needed
     .mkdir = osfs_mkdir,
+    .rmdir = osfs_rmdir,
+    .rename = osfs_rename,
+    .link = osfs_link,
+    .unlink = osfs_unlink,
+    .setattr = osfs_setattr,
+    .listxattr = osfs_listxattr,
+    .fileattr_get = osfs_fileattr_get,
+    .fileattr_set = osfs_fileattr_set,
 };
 
 const struct file_operations osfs_dir_operations = {
     .iterate_shared = osfs_iterate,
     .llseek = generic_file_llseek,
+    .unlocked_ioctl = osfs_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     // Add other operations as needed
 };
@@ -0,0 +1,215 @@
+#include <linux/fs.h>
+#include <linux/jhash.h>
+#include <linux/list_bl.h>
+#include <linux/log2.h>
+#include <linux/rculist_bl.h>
+#include <linux/slab.h>
+#include "osfs.h"
+
+/*
+ * Directory index: one hash table per superblock mapping (directory inode,
+ * name) to the child inode and its slot in the directory block. Buckets are
+ * hlist_bl heads, so writers serialize on a bit lock in the bucket head and
+ * readers walk the chains under RCU without taking any lock. Since osfs
+ * lives in memory and starts empty, the index is always complete: a miss
+ * is authoritative and no directory block needs to be scanned. Entries
+ * live as long as their dirent, not their dentry, so pruning the dcache
+ * costs nothing here; the table is bounded by the directory capacity of
+ * the mount, at one small entry per name.
+ */
+
+static inline uint32_t osfs_dindex_hash(uint32_t dir, const char *name, size_t len)
+{
+    return jhash(name, len, dir);
+}
+
+static inline struct hlist_bl_head *osfs_dindex_bucket(struct osfs_sb_info *sb_info, uint32_t hash)
+{
+    return &sb_info->dir_index[hash & (sb_info->dir_index_size - 1)];
+}
+
+static inline bool osfs_dindex_match(const struct osfs_dindex_entry *e, uint32_t dir, uint32_t hash,
+                                     const char *name, size_t len)
+{
+    return e->hash == hash && e->dir == dir && e->name_len == len && !memcmp(e->name, name, len);
+}
+
+/**
+ * Function: osfs_dindex_init
+ * Description: Allocates the directory index of a superblock.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOMEM if the bucket array cannot be allocated.
+ */
+int osfs_dindex_init(struct osfs_sb_info *sb_info)
+{
+    uint32_t size = roundup_pow_of_two(max(sb_info->inode_count, 64U));
+    uint32_t i;
+
+    sb_info->dir_index = kvmalloc_array(size, sizeof(*sb_info->dir_index), GFP_KERNEL);
+    if (!sb_info->dir_index)
+        return -ENOMEM;
+    for (i = 0; i < size; i++)
+        INIT_HLIST_BL_HEAD(&sb_info->dir_index[i]);
+    sb_info->dir_index_size = size;
+    return 0;
+}
+
+/**
+ * Function: osfs_dindex_destroy
+ * Description: Frees every index entry and the bucket array. Only called
+ *              by the teardown worker once the superblock is shut down, so
+ *              no reader can remain.
+ */
+void osfs_dindex_destroy(struct osfs_sb_info *sb_info)
+{
+    struct osfs_dindex_entry *e;
+    struct hlist_bl_node *pos, *n;
+    uint32_t i;
+
+    if (!sb_info->dir_index)
+        return;
+    for (i = 0; i < sb_info->dir_index_size; i++) {
+        hlist_bl_for_each_entry_safe(e, pos, n, &sb_info->dir_index[i], node)
+            kfree(e);
+        if (!(i & 1023))
+            cond_resched();
+    }
+    kvfree(sb_info->dir_index);
+    sb_info->dir_index = NULL;
+}
+
+/**
+ * Function: osfs_dindex_lookup
+ * Description: Resolves a name in a directory without taking any lock.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - dir: The directory inode number.
+ *   - name, len: The name to resolve.
+ * Returns:
+ *   - The child inode number, or 0 if the name does not exist.
+ */
+uint32_t osfs_dindex_lookup(struct osfs_sb_info *sb_info, uint32_t dir, const char *name, size_t len)
+{
+    struct osfs_dindex_entry *e;
+    uint32_t ino = 0;
+
+    rcu_read_lock();
+    e = osfs_dindex_find(sb_info, dir, name, len);
+    if (e)
+        ino = READ_ONCE(e->ino);
+    rcu_read_unlock();
+
+    return ino;
+}
+
+/**
+ * Function: osfs_dindex_find
+ * Description: Returns the index entry of a name. Callers hold
+ *              rcu_read_lock(); the entry stays usable after unlocking only
+ *              while the directory's i_rwsem is held, as entries are removed
+ *              under it.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - dir: The directory inode number.
+ *   - name, len: The name to resolve.
+ * Returns:
+ *   - The index entry, or NULL if the name does not exist.
+ */
+struct osfs_dindex_entry *osfs_dindex_find(struct osfs_sb_info *sb_info, uint32_t dir,
+                                           const char *name, size_t len)
+{
+    uint32_t hash = osfs_dindex_hash(dir, name, len);
+    struct osfs_dindex_entry *e;
+    struct hlist_bl_node *pos;
+
+    hlist_bl_for_each_entry_rcu(e, pos, osfs_dindex_bucket(sb_info, hash), node) {
+        if (osfs_dindex_match(e, dir, hash, name, len))
+            return e;
+    }
+    return NULL;
+}
+
+/**
+ * Function: osfs_dindex_insert
+ * Description: Publishes a new name in the index. The duplicate check and
+ *              the insertion happen under the bucket lock, so two racing
+ *              inserts of one name cannot both succeed. The dirent slot is
+ *              filled in afterwards with osfs_dindex_set_slot().
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - dir: The directory inode number.
+ *   - name, len: The entry name.
+ *   - ino: The child inode number.
+ * Returns:
+ *   - The new index entry on success.
+ *   - ERR_PTR(-EEXIST) if the name already exists in dir.
+ *   - ERR_PTR(-ENOMEM) if the entry cannot be allocated.
+ */
+struct osfs_dindex_entry *osfs_dindex_insert(struct osfs_sb_info *sb_info, uint32_t dir,
+                                             const char *name, size_t len, uint32_t ino)
+{
+    uint32_t hash = osfs_dindex_hash(dir, name, len);
+    struct hlist_bl_head *bucket = osfs_dindex_bucket(sb_info, hash);
+    struct osfs_dindex_entry *e, *new;
+    struct hlist_bl_node *pos;
+
+    new = kmalloc(struct_size(new, name, len), GFP_KERNEL);
+    if (!new)
+        return ERR_PTR(-ENOMEM);
+    new->dir = dir;
+    new->hash = hash;
+    new->ino = ino;
+    new->slot = U16_MAX;
+    new->name_len = len;
+    memcpy(new->name, name, len);
+
+    osfs_bl_lock(bucket);
+    hlist_bl_for_each_entry(e, pos, bucket, node) {
+        if (osfs_dindex_match(e, dir, hash, name, len)) {
+            hlist_bl_unlock(bucket);
+            kfree(new);
+            return ERR_PTR(-EEXIST);
+        }
+    }
+    hlist_bl_add_head_rcu(&new->node, bucket);
+    hlist_bl_unlock(bucket);
+
+    return new;
+}
+
+/**
+ * Function: osfs_dindex_set_slot
+ * Description: Records the dirent slot backing an index entry.
+ */
+void osfs_dindex_set_slot(struct osfs_dindex_entry *e, uint16_t slot)
+{
+    WRITE_ONCE(e->slot, slot);
+}
+
+/**
+ * Function: osfs_dindex_set_ino
+ * Description: Repoints a name at another inode (rename over an existing
+ *              target, exchange). Lock-free readers see either inode.
+ */
+void osfs_dindex_set_ino(struct osfs_dindex_entry *e, uint32_t ino)
+{
+    WRITE_ONCE(e->ino, ino);
+}
+
+/**
+ * Function: osfs_dindex_remove
+ * Description: Unpublishes an index entry; it is freed after a grace period
+ *              since lock-free lookups may still be walking past it.
+ */
+void osfs_dindex_remove(struct osfs_sb_info *sb_info, struct osfs_dindex_entry *e)
+{
+    struct hlist_bl_head *bucket = osfs_dindex_bucket(sb_info, e->hash);
+
+    osfs_bl_lock(bucket);
+    hlist_bl_del_rcu(&e->node);
+    hlist_bl_unlock(bucket);
+    kfree_rcu(e, rcu);
+}
@@ -0,0 +1,76 @@
+#include <linux/fs.h>
+#include <linux/exportfs.h>
+#include "osfs.h"
+
+/*
+ * NFS export. File handles carry the 32-bit inode number and generation
+ * (generic_encode_ino32_fh), so decoding a handle is a bounds check, a
+ * bitmap test and an inode hash lookup: the inode table slot is addressed
+ * directly and no path is walked. The generation changes every time an
+ * inode number is reused, which turns handles to deleted files into
+ * -ESTALE instead of silently reaching the new file.
+ */
+
+/**
+ * Function: osfs_nfs_get_inode
+ * Description: Resolves a file handle to an inode.
+ * Inputs:
+ *   - sb: The superblock of the filesystem.
+ *   - ino: The inode number from the handle.
+ *   - generation: The generation from the handle, 0 to skip the check.
+ * Returns:
+ *   - The inode on success.
+ *   - ERR_PTR(-ESTALE) if the inode no longer exists or was reused.
+ */
+static struct inode *osfs_nfs_get_inode(struct super_block *sb, u64 ino, u32 generation)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct inode *inode;
+
+    if (ino < ROOT_INODE || ino >= sb_info->inode_count || !test_bit(ino, sb_info->inode_bitmap))
+        return ERR_PTR(-ESTALE);
+
+    inode = osfs_iget(sb, ino);
+    if (IS_ERR(inode))
+        return ERR_CAST(inode);
+    if ((generation && inode->i_generation != generation) || !inode->i_nlink) {
+        iput(inode);
+        return ERR_PTR(-ESTALE);
+    }
+    return inode;
+}
+
+static struct dentry *osfs_fh_to_dentry(struct super_block *sb, struct fid *fid, int fh_len, int fh_type)
+{
+    return generic_fh_to_dentry(sb, fid, fh_len, fh_type, osfs_nfs_get_inode);
+}
+
+static struct dentry *osfs_fh_to_parent(struct super_block *sb, struct fid *fid, int fh_len, int fh_type)
+{
+    return generic_fh_to_parent(sb, fid, fh_len, fh_type, osfs_nfs_get_inode);
+}
+
+/**
+ * Function: osfs_get_parent
+ * Description: Returns the parent of a directory, used by knfsd to
+ *              reconnect dentries decoded from handles. Directories record
+ *              their parent in i_parent, so no ".." entry is scanned.
+ * Inputs:
+ *   - child: The directory dentry.
+ * Returns:
+ *   - The parent dentry, or an ERR_PTR.
+ */
+static struct dentry *osfs_get_parent(struct dentry *child)
+{
+    struct inode *inode = d_inode(child);
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    return d_obtain_alias(osfs_iget(inode->i_sb, READ_ONCE(osfs_inode->i_parent)));
+}
+
+const struct export_operations osfs_export_ops = {
+    .encode_fh = generic_encode_ino32_fh,
+    .fh_to_dentry = osfs_fh_to_dentry,
+    .fh_to_parent = osfs_fh_to_parent,
+    .get_parent = osfs_get_parent,
+};
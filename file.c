@@ -1,71 +1,359 @@
 #include <linux/fs.h>
+#include <linux/pagemap.h>
 #include <linux/uaccess.h>
 #include "osfs.h"
 
 /**
- * Function: osfs_read
- * Description: Reads data from a file.
+ * Function: osfs_walk
+ * Description: Walks the FAT chain to a block index that exists. The walk
+ *              resumes from the last position looked up (kept packed in one
+ *              word, so concurrent readers never see a torn pair), which
+ *              makes sequential I/O on large files linear rather than
+ *              quadratic.
  * Inputs:
- *   - filp: The file pointer representing the file to read from.
- *   - buf: The user-space buffer to copy the data into.
- *   - len: The number of bytes to read.
- *   - ppos: The file position pointer.
+ *   - inode: The file.
+ *   - target: The block index, below i_blocks.
+ *   - prev: Set to the block before target, or OSFS_NO_BLOCK if the walk
+ *     started at target.
+ * Returns:
+ *   - The data block number.
+ */
+static uint32_t osfs_walk(struct inode *inode, uint64_t target, uint32_t *prev)
+{
+    struct osfs_inode_info *oi = OSFS_I(inode);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint64_t cursor, pos = 0;
+    uint32_t block = osfs_inode->i_block;
+
+    // The cursor stores (index + 1) << 32 | block, 0 when unset
+    cursor = READ_ONCE(oi->i_cursor);
+    if (cursor && (cursor >> 32) - 1 <= target) {
+        pos = (cursor >> 32) - 1;
+        block = (uint32_t)cursor;
+    }
+    *prev = OSFS_NO_BLOCK;
+    for (; pos < target; pos++) {
+        *prev = block;
+        block = *osfs_fat(sb_info, block);
+    }
+    WRITE_ONCE(oi->i_cursor, ((pos + 1) << 32) | block);
+    return block;
+}
+
+/**
+ * Function: osfs_unshare_block
+ * Description: Copy-on-write of a block an overlay shares with its base:
+ *              copies it into a private block and links the copy into the
+ *              chain in its place. The copy is published with a release
+ *              store, so osfs_read_small() never sees it before its data.
+ * Inputs:
+ *   - inode: The file.
+ *   - index: The block index within the file.
+ *   - prev: The block before index, unused for index 0.
+ *   - block: In/out, the shared block, replaced by the private copy.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if no private block is available.
+ */
+static int osfs_unshare_block(struct inode *inode, uint64_t index, uint32_t prev, uint32_t *block)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint32_t new_block;
+    bool counted;
+    int ret;
+
+    ret = osfs_alloc_data_block(sb_info, &new_block);
+    if (ret)
+        return ret;
+    memcpy(osfs_block_addr(sb_info, new_block), osfs_block_addr(sb_info, *block), BLOCK_SIZE);
+    counted = osfs_view_begin(sb_info);
+    *osfs_fat(sb_info, new_block) = *osfs_fat(sb_info, *block);
+    if (index == 0)
+        smp_store_release(&osfs_inode->i_block, new_block);
+    else
+        smp_store_release(osfs_fat(sb_info, prev), new_block);
+    osfs_view_end(sb_info, counted);
+    WRITE_ONCE(OSFS_I(inode)->i_cursor, ((index + 1) << 32) | new_block);
+    *block = new_block;
+    return 0;
+}
+
+/**
+ * Function: osfs_file_block
+ * Description: Maps a block index of a file to its data block. With
+ *              OSFS_FB_CREATE the chain is extended with zeroed blocks up to
+ *              index; with OSFS_FB_WRITE a block shared with an overlay's
+ *              base is first unshared. Both require inode_lock.
+ * Inputs:
+ *   - inode: The file.
+ *   - index: The block index within the file.
+ *   - flags: OSFS_FB_CREATE and/or OSFS_FB_WRITE.
+ *   - block_no: Pointer to store the data block number.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENODATA if the block lies past the end of the chain (a hole reading
+ *     as zeroes) and OSFS_FB_CREATE is not set.
+ *   - -ENOSPC if no free data block is available.
+ */
+int osfs_file_block(struct inode *inode, uint64_t index, int flags, uint32_t *block_no)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint32_t nr_blocks = READ_ONCE(osfs_inode->i_blocks);
+    uint32_t block = 0, prev, new_block;
+    uint64_t pos;
+    int ret;
+
+    if (index >= nr_blocks && !(flags & OSFS_FB_CREATE))
+        return -ENODATA;
+
+    if (nr_blocks) {
+        uint64_t target = min_t(uint64_t, index, nr_blocks - 1);
+
+        block = osfs_walk(inode, target, &prev);
+        if (index == target) {
+            if ((flags & OSFS_FB_WRITE) && osfs_block_shared(sb_info, block)) {
+                if (index && prev == OSFS_NO_BLOCK) {
+                    // The cursor sat on index itself; walk again for prev
+                    WRITE_ONCE(OSFS_I(inode)->i_cursor, 0);
+                    osfs_walk(inode, index, &prev);
+                }
+                ret = osfs_unshare_block(inode, index, prev, &block);
+                if (ret)
+                    return ret;
+            }
+            *block_no = block;
+            return 0;
+        }
+    }
+
+    // Extend the chain; fresh blocks are zeroed so holes and tails read as 0.
+    // Each block is placed after the one before it, the first near the
+    // file's directory.
+    for (pos = nr_blocks; pos <= index; pos++) {
+        ret = osfs_alloc_data_block_near(sb_info, pos ? block + 1 : osfs_place_file(sb_info, osfs_inode),
+                                         &new_block);
+        if (ret)
+            return ret;
+        memset(osfs_block_addr(sb_info, new_block), 0, BLOCK_SIZE);
+        if (pos == 0) {
+            osfs_inode->i_block = new_block;
+        } else {
+            bool counted = osfs_view_begin(sb_info);
+
+            *osfs_fat(sb_info, block) = new_block;
+            osfs_view_end(sb_info, counted);
+        }
+        block = new_block;
+        // Publishes i_block and the zeroed block to osfs_read_small()
+        smp_store_release(&osfs_inode->i_blocks, pos + 1);
+        inode->i_blocks = osfs_vfs_blocks(pos + 1);
+    }
+    WRITE_ONCE(OSFS_I(inode)->i_cursor, ((index + 1) << 32) | block);
+    *block_no = block;
+    return 0;
+}
+
+/**
+ * Function: osfs_truncate
+ * Description: Sets the size of a file. Shrinking frees the blocks past the
+ *              new end and zeroes the tail of the last block; growing only
+ *              moves i_size, the range beyond the chain reads as a hole.
+ *              Callers hold inode_lock. Changes a lockless reader of a small
+ *              file could observe are made inside the i_seq write section.
+ * Inputs:
+ *   - inode: The file.
+ *   - size: The new size in bytes.
+ * Returns:
+ *   - 0 on success.
+ */
+int osfs_truncate(struct inode *inode, loff_t size)
+{
+    struct osfs_inode_info *oi = OSFS_I(inode);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint64_t keep = DIV_ROUND_UP((uint64_t)size, BLOCK_SIZE);
+    bool small = osfs_inode->i_size <= BLOCK_SIZE;
+    bool zero_tail = (size & (BLOCK_SIZE - 1)) && size < osfs_inode->i_size;
+    uint32_t block, next, i, last = 0, tail = 0;
+
+    // Bytes past i_size inside the last block must read as zero on regrowth.
+    // Unsharing the block may have to grow the mount, which sleeps, so it
+    // is looked up before the write section.
+    if (zero_tail && osfs_file_block(inode, size >> BLOCK_SIZE_BITS, OSFS_FB_WRITE, &tail))
+        zero_tail = false;
+
+    // Readers skip files above one block, so only then may blocks be freed
+    // outside the write section (and with preemption enabled)
+    if (small)
+        write_seqcount_begin(&oi->i_seq);
+
+    if (keep < osfs_inode->i_blocks) {
+        if (keep) {
+            osfs_file_block(inode, keep - 1, 0, &last);
+            block = *osfs_fat(sb_info, last);
+        } else {
+            block = osfs_inode->i_block;
+        }
+        for (i = keep; i < osfs_inode->i_blocks; i++) {
+            next = *osfs_fat(sb_info, block);
+            osfs_free_data_block(sb_info, block);
+            block = next;
+        }
+        WRITE_ONCE(oi->i_cursor, 0);
+        WRITE_ONCE(osfs_inode->i_blocks, keep);
+        inode->i_blocks = osfs_vfs_blocks(keep);
+    }
+
+    if (!small)
+        write_seqcount_begin(&oi->i_seq);
+
+    if (zero_tail)
+        memset(osfs_block_addr(sb_info, tail) + (size & (BLOCK_SIZE - 1)), 0,
+               BLOCK_SIZE - (size & (BLOCK_SIZE - 1)));
+
+    WRITE_ONCE(osfs_inode->i_size, size);
+    write_seqcount_end(&oi->i_seq);
+    i_size_write(inode, size);
+    inode_maybe_inc_iversion(inode, false);
+    return 0;
+}
+
+/**
+ * Function: osfs_read_small
+ * Description: Lockless read of a file of at most one block. Snapshots
+ *              i_size and the first block under the i_seq read section,
+ *              copies, and retries if a writer ran meanwhile. Takes no lock
+ *              and writes no shared memory, so concurrent readers of a hot
+ *              small file do not contend.
+ * Inputs:
+ *   - iocb, to: As for osfs_read_iter.
+ * Returns:
+ *   - The number of bytes read.
+ *   - -EFAULT (-EAGAIN with IOCB_NOWAIT) if nothing could be copied.
+ *   - -ENOTBLK if the file is larger than one block; the caller falls back
+ *     to the locked path.
+ */
+static ssize_t osfs_read_small(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct inode *inode = file_inode(iocb->ki_filp);
+    struct osfs_inode_info *oi = OSFS_I(inode);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    loff_t pos = iocb->ki_pos;
+    size_t n, copied;
+    unsigned int seq;
+    uint64_t size;
+    void *addr;
+
+    for (;;) {
+        seq = read_seqcount_begin(&oi->i_seq);
+        size = READ_ONCE(osfs_inode->i_size);
+        if (size > BLOCK_SIZE)
+            return -ENOTBLK;
+        if (pos >= size)
+            return 0;
+        n = min_t(uint64_t, iov_iter_count(to), size - pos);
+        // i_blocks is published after i_block, see osfs_file_block()
+        addr = NULL;
+        if (smp_load_acquire(&osfs_inode->i_blocks))
+            addr = osfs_block_addr(sb_info, READ_ONCE(osfs_inode->i_block)) + pos;
+        copied = osfs_copy_to_iter(iocb, addr, n, to);
+        if (!read_seqcount_retry(&oi->i_seq, seq))
+            break;
+        iov_iter_revert(to, copied);
+    }
+
+    if (!copied)
+        return osfs_copy_fault(iocb);
+    return copied;
+}
+
+/**
+ * Function: osfs_read_iter
+ * Description: Reads data from a file. Data blocks are always resident and
+ *              a read never allocates, so with IOCB_NOWAIT (RWF_NOWAIT,
+ *              io_uring) the only ways to block are a contended inode_lock
+ *              and a fault on the destination buffer; both end the read
+ *              with -EAGAIN, or short if some bytes were copied.
+ * Inputs:
+ *   - iocb: The read, at iocb->ki_pos.
+ *   - to: The destination buffer.
  * Returns:
  *   - The number of bytes read on success.
  *   - 0 if the end of the file is reached.
  *   - -EFAULT if copying data to user space fails.
+ *   - -EAGAIN if the read would block under IOCB_NOWAIT.
  */
-static ssize_t osfs_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
+static ssize_t osfs_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
+    struct file *filp = iocb->ki_filp;
     struct inode *inode = file_inode(filp);
     struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
-    void *data_block;
+    size_t len = iov_iter_count(to), copied;
+    uint64_t size;
+    loff_t pos = iocb->ki_pos;
     ssize_t bytes_read = 0;
+    uint32_t block;
+    int ret;
 
-    // If the file has not been allocated a data block, it indicates the file is empty
-    if (osfs_inode->i_blocks == 0)
+    if (!len)
         return 0;
+    osfs_fg_touch(sb_info);
+
+    // Fast paths: sealed and small files are read without taking inode_lock
+    bytes_read = osfs_read_sealed(iocb, to);
+    if (bytes_read == -ENOTBLK)
+        bytes_read = osfs_read_small(iocb, to);
+    if (bytes_read != -ENOTBLK) {
+        if (bytes_read > 0) {
+            iocb->ki_pos = pos + bytes_read;
+            file_accessed(filp);
+        }
+        osfs_trace(inode->i_sb, OSFS_TRACE_READ, inode, NULL, NULL, pos, len, bytes_read);
+        return bytes_read;
+    }
+    bytes_read = 0;
+
+    if (iocb->ki_flags & IOCB_NOWAIT) {
+        if (!osfs_inode_trylock_shared(inode))
+            return -EAGAIN;
+    } else {
+        osfs_inode_lock_shared(inode);
+    }
+    size = osfs_inode->i_size;
 
     // if offset out of file size, return 0
-    if (*ppos >= osfs_inode->i_size)
+    if (pos >= size) {
+        inode_unlock_shared(inode);
         return 0;
+    }
 
     // if the read length exceeds the file size, adjust the length
-    if (*ppos + len > osfs_inode->i_size)
-        len = osfs_inode->i_size - *ppos;
-    
-    ssize_t bytes_to_read = len;
-    
-    pr_info("osfs_read: Reading %ld bytes from %lld\n", len, *ppos);
-
-    // traverse to the block containing ppos
-    uint32_t fat_block_pointer = osfs_inode->i_block;
-    uint32_t current_block_index = 0;
-    while(*ppos > (current_block_index + 1) * BLOCK_SIZE)
-    {
-        fat_block_pointer = sb_info->fat[fat_block_pointer];
-        current_block_index++;
-    }
+    len = min_t(uint64_t, len, size - pos);
 
-    // read data
-    while(bytes_to_read > 0)
-    {
-        ssize_t current_block_bytes_to_read = (*ppos % BLOCK_SIZE + bytes_to_read) > BLOCK_SIZE ? (BLOCK_SIZE - *ppos % BLOCK_SIZE) : bytes_to_read;
-        pr_info("osfs_read: Reading %ld bytes from block %u\n", current_block_bytes_to_read, fat_block_pointer);
-        data_block = sb_info->data_blocks + fat_block_pointer * BLOCK_SIZE + *ppos % BLOCK_SIZE;
-        if(copy_to_user(buf + bytes_read, data_block, current_block_bytes_to_read))
-        {
-            return -EFAULT;
-        }
-        bytes_read += current_block_bytes_to_read;
-        bytes_to_read -= current_block_bytes_to_read;
-        fat_block_pointer = sb_info->fat[fat_block_pointer];
-        current_block_index++;
+    while (bytes_read < len) {
+        size_t offset = pos & (BLOCK_SIZE - 1);
+        size_t chunk = min_t(size_t, len - bytes_read, BLOCK_SIZE - offset);
+
+        ret = osfs_file_block(inode, pos >> BLOCK_SIZE_BITS, 0, &block);
+        copied = osfs_copy_to_iter(iocb, ret == -ENODATA ? NULL : osfs_block_addr(sb_info, block) + offset,
+                                   chunk, to);
+        bytes_read += copied;
+        pos += copied;
+        if (copied < chunk)
+            break;
     }
+    inode_unlock_shared(inode);
 
-    *ppos += bytes_read;
-    pr_info("osfs_read: %ld bytes read\n", bytes_read);
+    if (!bytes_read)
+        return osfs_copy_fault(iocb);
+    osfs_trace(inode->i_sb, OSFS_TRACE_READ, inode, NULL, NULL, iocb->ki_pos, len, bytes_read);
+    iocb->ki_pos = pos;
+    file_accessed(filp);   // relatime/noatime policy is applied by the VFS
 
     return bytes_read;
 }
@@ -73,111 +361,148 @@ static ssize_t osfs_read(struct file *filp, char __user *buf, size_t len, loff_t
 
 /**
  * Function: osfs_write
- * Description: Writes data to a file.
+ * Description: Writes data to a file, extending the block chain as needed.
+ *              Writes past the end of the chain leave zero-filled blocks in
+ *              between.
  * Inputs:
  *   - filp: The file pointer representing the file to write to.
  *   - buf: The user-space buffer containing the data to write.
  *   - len: The number of bytes to write.
  *   - ppos: The file position pointer.
  * Returns:
- *   - The number of bytes written on success.
+ *   - The number of bytes written on success (short if space runs out).
  *   - -EFAULT if copying data from user space fails.
- *   - Adjusted length if the write exceeds the block size.
+ *   - -EFBIG if the write starts beyond s_maxbytes.
+ *   - -ENOSPC if no data block is available.
  */
 static ssize_t osfs_write(struct file *filp, const char __user *buf, size_t len, loff_t *ppos)
 {   
     //Step1: Retrieve the inode and filesystem information
     struct inode *inode = file_inode(filp);
+    struct osfs_inode_info *oi = OSFS_I(inode);
     struct osfs_inode *osfs_inode = inode->i_private;
     struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    ssize_t bytes_written = 0;
+    loff_t pos, count;
+    uint32_t block;
+    bool small;
+    int ret;
+
+    osfs_fg_touch(sb_info);
+    osfs_inode_lock(inode);
+
+    // A descriptor opened for writing before chattr +i
+    if (IS_IMMUTABLE(inode)) {
+        ret = -EPERM;
+        goto out_unlock;
+    }
 
     // Check if the file is opened in append mode
     if(filp->f_flags & O_APPEND)
-    {
-        pr_info("osfs_write: Append mode selected\n");
         *ppos = osfs_inode->i_size;
-    }
+    pos = *ppos;
 
-    void *data_block;
-    ssize_t bytes_written = 0;
-    ssize_t bytes_to_write = len;
-    int ret;
+    // Step2: Clamp the write to s_maxbytes and RLIMIT_FSIZE
+    count = len;
+    ret = generic_write_check_limits(filp, pos, &count);
+    if (ret)
+        goto out_unlock;
+    len = count;
+
+    // Only the VFS inode is stamped; osfs_write_inode folds it later
+    ret = file_update_time(filp);
+    if (ret)
+        goto out_unlock;
+
+    // Lockless readers may be copying out of block 0 of a small file
+    small = osfs_inode->i_size <= BLOCK_SIZE;
+
+    // Step3: Copy block by block, allocating blocks on demand
+    while (bytes_written < len) {
+        size_t offset = pos & (BLOCK_SIZE - 1);
+        size_t chunk = min_t(size_t, len - bytes_written, BLOCK_SIZE - offset);
+        void *dst;
+        unsigned long left;
 
-    pr_info("osfs_write: Writing %ld bytes from %lld\n", len, *ppos);
-    // Step2: Check if a data block has been allocated; if not, allocate one
-    if(osfs_inode->i_blocks == 0)
-    {
-        pr_info("osfs_write: No data block allocated\n");
-        ret = osfs_alloc_data_block(sb_info, &osfs_inode->i_block);
-        if(ret)
-        {
+        ret = osfs_file_block(inode, pos >> BLOCK_SIZE_BITS, OSFS_FB_CREATE | OSFS_FB_WRITE, &block);
+        if (ret) {
             pr_err("osfs_write: Failed to allocate data block\n");
-            return ret;
+            break;
         }
-        osfs_inode->i_size = 0;
-        inode->i_size = 0;
-        // allocated 1 block
-        osfs_inode->i_blocks = 1;
-        inode->i_blocks = 1;
-    }
+        dst = osfs_block_addr(sb_info, block) + offset;
 
-    // Allocate blank blocks between current end to ppos
-    uint32_t new_block;
-    uint32_t fat_block_pointer = osfs_inode->i_block;   // always points to valid block
-    uint32_t current_block_index = 0;
-
-    while(bytes_to_write > 0)
-    {
-        // TODO: if current is invalid, allocate new block
-        if(current_block_index >= osfs_inode->i_blocks)
-        {
-            ret = osfs_alloc_data_block(sb_info, &new_block);
-            if(ret)
-            {
-                pr_err("osfs_write: Failed to allocate data block\n");
-                return ret;
-            }
-            pr_info("osfs_write: Allocated new block %u\n", new_block);
-            // update fat
-            sb_info->fat[fat_block_pointer] = new_block;
-            fat_block_pointer = new_block;
-            osfs_inode->i_blocks++;
-            inode->i_blocks++;
+        if (small && pos < BLOCK_SIZE) {
+            // The write section disables preemption, so the copy must not
+            // sleep: fault the source in outside of it and retry instead
+            write_seqcount_begin(&oi->i_seq);
+            pagefault_disable();
+            left = __copy_from_user_inatomic(dst, buf + bytes_written, chunk);
+            pagefault_enable();
+            write_seqcount_end(&oi->i_seq);
+        } else {
+            left = copy_from_user(dst, buf + bytes_written, chunk);
         }
-        // TODO: if ppos is not in current block, move to next block
-        if(*ppos > (current_block_index + 1) * BLOCK_SIZE)
-        {
-            // if next block is invalid, dont change fat ptr
-            if(current_block_index + 1 < osfs_inode->i_blocks)
-            {
-                fat_block_pointer = sb_info->fat[fat_block_pointer];
-            }
-        }
-        // TODO: else write data to current block
-        else
-        {
-            ssize_t current_block_bytes_to_write = (*ppos % BLOCK_SIZE + bytes_to_write) > BLOCK_SIZE ? (BLOCK_SIZE - *ppos % BLOCK_SIZE) : bytes_to_write;
-            data_block = sb_info->data_blocks + fat_block_pointer * BLOCK_SIZE + *ppos % BLOCK_SIZE;
-            if(copy_from_user(data_block, buf + bytes_written, current_block_bytes_to_write))
-            {
-                return -EFAULT;
-            }
-            bytes_written += current_block_bytes_to_write;
-            bytes_to_write -= current_block_bytes_to_write;
+        bytes_written += chunk - left;
+        pos += chunk - left;
+        if (left && (!small || fault_in_readable(buf + bytes_written, left) == left)) {
+            ret = -EFAULT;
+            break;
         }
-        current_block_index++;
     }
 
-    // Update inode & osfs_inode attribute
-    // extend size if needed
-    osfs_inode->i_size = (*ppos + bytes_written) > osfs_inode->i_size ? (*ppos + bytes_written) : osfs_inode->i_size;
-    inode->i_size = osfs_inode->i_size;
-    *ppos += len;
+    // Step4: Extend size if needed
+    if (pos > osfs_inode->i_size) {
+        if (small)
+            write_seqcount_begin(&oi->i_seq);
+        WRITE_ONCE(osfs_inode->i_size, pos);
+        if (small)
+            write_seqcount_end(&oi->i_seq);
+        i_size_write(inode, pos);
+    }
+    // file_update_time() bumped it before the copy; a query since then
+    // must not match the new data
+    if (bytes_written)
+        inode_maybe_inc_iversion(inode, false);
+    osfs_trace(inode->i_sb, OSFS_TRACE_WRITE, inode, NULL, NULL, *ppos, len, bytes_written ? bytes_written : ret);
+    *ppos = pos;
+
+out_unlock:
+    inode_unlock(inode);
+    if (bytes_written)
+        return bytes_written;
+    return ret;
+}
+
+/**
+ * Function: osfs_ioctl
+ * Description: ioctls of files and directories (see osfs_uapi.h).
+ * Returns:
+ *   - 0 on success.
+ *   - -EFAULT if the argument cannot be written.
+ *   - -ENOTTY for unknown commands.
+ */
+long osfs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct inode *inode = file_inode(filp);
 
-    // Step6: Return the number of bytes written
+    switch (cmd) {
+    case OSFS_IOC_GETVERSION:
+        return put_user((__u64)inode_query_iversion(inode), (__u64 __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
 
-    pr_info("osfs_write: %ld bytes written, new size: %u\n", bytes_written, osfs_inode->i_size);
-    return bytes_written;
+/**
+ * Function: osfs_file_open
+ * Description: Opens a regular file. Reads honor IOCB_NOWAIT, so the file
+ *              is marked FMODE_NOWAIT for RWF_NOWAIT and io_uring; writes
+ *              still go through ->write, which the VFS never calls with it.
+ */
+static int osfs_file_open(struct inode *inode, struct file *filp)
+{
+    filp->f_mode |= FMODE_NOWAIT;
+    return generic_file_open(inode, filp);
 }
 
 /**
@@ -185,9 +510,12 @@ static ssize_t osfs_write(struct file *filp, const char __user *buf, size_t len,
  * Description: Defines the file operations for regular files in osfs.
  */
 const struct file_operations osfs_file_operations = {
-    .open = generic_file_open, // Use generic open or implement osfs_open if needed
-    .read = osfs_read,
+    .open = osfs_file_open,
+    .read_iter = osfs_read_iter,
     .write = osfs_write,
+    .mmap = osfs_file_mmap,             // Sealed files only
+    .unlocked_ioctl = osfs_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     .llseek = default_llseek,
     // Add other operations as needed
 };
@@ -199,4 +527,8 @@ const struct file_operations osfs_file_operations = {
  */
 const struct inode_operations osfs_file_inode_operations = {
     // Add inode operations here, e.g., .getattr = osfs_getattr,
+    .setattr = osfs_setattr,
+    .listxattr = osfs_listxattr,
+    .fileattr_get = osfs_fileattr_get,
+    .fileattr_set = osfs_fileattr_set,
 };
@@ -1,7 +1,95 @@
 #include <linux/fs.h>
+#include <linux/pagemap.h>
 #include <linux/uaccess.h>
 #include "osfs.h"
 
+static struct kmem_cache *osfs_inode_cachep;
+
+static void osfs_inode_init_once(void *obj)
+{
+    struct osfs_inode_info *oi = obj;
+
+    inode_init_once(&oi->vfs_inode);
+    seqcount_rwsem_init(&oi->i_seq, &oi->vfs_inode.i_rwsem);
+}
+
+/**
+ * Function: osfs_inode_cache_init
+ * Description: Creates the slab cache for osfs_inode_info at module load.
+ * Returns:
+ *   - 0 on success, -ENOMEM on failure.
+ */
+int osfs_inode_cache_init(void)
+{
+    osfs_inode_cachep = kmem_cache_create("osfs_inode_cache", sizeof(struct osfs_inode_info), 0,
+                                          SLAB_RECLAIM_ACCOUNT | SLAB_ACCOUNT, osfs_inode_init_once);
+    return osfs_inode_cachep ? 0 : -ENOMEM;
+}
+
+/**
+ * Function: osfs_inode_cache_exit
+ * Description: Destroys the inode cache. Callers wait for RCU-delayed
+ *              osfs_free_inode calls with rcu_barrier() first.
+ */
+void osfs_inode_cache_exit(void)
+{
+    kmem_cache_destroy(osfs_inode_cachep);
+}
+
+/**
+ * Function: osfs_alloc_inode
+ * Description: Allocates an in-memory inode with its osfs private state.
+ */
+struct inode *osfs_alloc_inode(struct super_block *sb)
+{
+    struct osfs_inode_info *oi = alloc_inode_sb(sb, osfs_inode_cachep, GFP_KERNEL);
+
+    if (!oi)
+        return NULL;
+    oi->i_cursor = 0;
+    RCU_INIT_POINTER(oi->i_map, NULL);
+    INIT_LIST_HEAD(&oi->i_dirty);
+    return &oi->vfs_inode;
+}
+
+void osfs_free_inode(struct inode *inode)
+{
+    kmem_cache_free(osfs_inode_cachep, OSFS_I(inode));
+}
+
+/**
+ * Function: osfs_setattr
+ * Description: Changes inode attributes; ATTR_SIZE truncates or extends a
+ *              regular file. The VFS holds inode_lock.
+ * Inputs:
+ *   - idmap: The idmap of the mount.
+ *   - dentry: The dentry of the inode.
+ *   - attr: The attributes to change.
+ * Returns:
+ *   - 0 on success.
+ *   - A negative error code from setattr_prepare on failure.
+ */
+int osfs_setattr(struct mnt_idmap *idmap, struct dentry *dentry, struct iattr *attr)
+{
+    struct inode *inode = d_inode(dentry);
+    int ret;
+
+    ret = setattr_prepare(idmap, dentry, attr);
+    if (ret)
+        return ret;
+
+    if ((attr->ia_valid & ATTR_SIZE) && S_ISREG(inode->i_mode) && attr->ia_size != i_size_read(inode)) {
+        ret = osfs_truncate(inode, attr->ia_size);
+        if (ret)
+            return ret;
+    }
+
+    setattr_copy(idmap, inode, attr);
+    inode_maybe_inc_iversion(inode, false);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
 /**
  * Function: osfs_get_osfs_inode
  * Description: Retrieves the osfs_inode structure for a given inode number.
@@ -23,31 +111,80 @@ struct osfs_inode *osfs_get_osfs_inode(struct super_block *sb, uint32_t ino)
 
 /**
  * Function: osfs_get_free_inode
- * Description: Allocates a free inode number from the inode bitmap.
+ * Description: Allocates a free inode number from the inode bitmap. Lock
+ *              free: a candidate bit is claimed with test_and_set_bit, and a
+ *              racing allocator that loses the bit moves on to the next one.
+ *              The search starts at goal (see osfs_place_inode()) and wraps
+ *              once.
  * Inputs:
  *   - sb_info: The superblock information of the filesystem.
+ *   - goal: The inode number to start at.
  * Returns:
  *   - The allocated inode number on success.
  *   - -ENOSPC if no free inode is available.
  */
-int osfs_get_free_inode(struct osfs_sb_info *sb_info)
+int osfs_get_free_inode(struct osfs_sb_info *sb_info, uint32_t goal)
 {
-    uint32_t ino;
+    u64 start = local_clock();
+    uint32_t end = sb_info->inode_count, ino, from;
+    int ret = -ENOSPC;
+    bool counted;
 
-    for (ino = 1; ino < sb_info->inode_count; ino++) {
-        if (!test_bit(ino, sb_info->inode_bitmap)) {
-            set_bit(ino, sb_info->inode_bitmap);
-            sb_info->nr_free_inodes--;
-            return ino;
+    if (goal <= ROOT_INODE || goal >= end)
+        goal = ROOT_INODE + 1;
+    for (ino = goal;;) {
+        from = ino;
+        ino = find_next_zero_bit(sb_info->inode_bitmap, end, ino);
+        this_cpu_add(osfs_stats.alloc[OSFS_ALLOC_INODE].scanned, ino - from);
+        if (ino >= end) {
+            if (goal == ROOT_INODE + 1)
+                break;
+            // Wrap around for the numbers before the goal
+            end = goal;
+            goal = ino = ROOT_INODE + 1;
+            continue;
+        }
+        counted = osfs_view_begin(sb_info);
+        if (!test_and_set_bit(ino, sb_info->inode_bitmap)) {
+            osfs_view_end(sb_info, counted);
+            atomic_dec(&sb_info->nr_free_inodes);
+            ret = ino;
+            break;
         }
+        osfs_view_end(sb_info, counted);
+        this_cpu_inc(osfs_stats.alloc[OSFS_ALLOC_INODE].retries);
     }
-    pr_err("osfs_get_free_inode: No free inode available\n");
-    return -ENOSPC;
+    osfs_alloc_stat(OSFS_ALLOC_INODE, start, ret < 0);
+    if (ret < 0)
+        pr_err("osfs_get_free_inode: No free inode available\n");
+    return ret;
+}
+
+/**
+ * Function: osfs_put_free_inode
+ * Description: Returns an inode number taken by osfs_get_free_inode to the
+ *              inode bitmap.
+ * Inputs:
+ *   - sb_info: The superblock information of the filesystem.
+ *   - ino: The inode number to release.
+ * Returns:
+ *   - None.
+ */
+void osfs_put_free_inode(struct osfs_sb_info *sb_info, uint32_t ino)
+{
+    bool counted;
+
+    counted = osfs_view_begin(sb_info);
+    clear_bit(ino, sb_info->inode_bitmap);
+    osfs_view_end(sb_info, counted);
+    atomic_inc(&sb_info->nr_free_inodes);
 }
 
 /**
  * Function: osfs_iget
  * Description: Creates or retrieves a VFS inode from a given inode number.
+ *              Inodes are looked up in the inode hash first, so every hard
+ *              link of a file shares one VFS inode.
  * Inputs:
  *   - sb: The superblock of the filesystem.
  *   - ino: The inode number to load.
@@ -55,6 +192,7 @@ int osfs_get_free_inode(struct osfs_sb_info *sb_info)
  *   - A pointer to the VFS inode on success.
  *   - ERR_PTR(-EFAULT) if the osfs_inode cannot be retrieved.
  *   - ERR_PTR(-ENOMEM) if memory allocation for the inode fails.
+ *   - ERR_PTR(-ESTALE) if the inode number is not in use.
  */
 struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
 {
@@ -65,12 +203,18 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     if (!osfs_inode)
         return ERR_PTR(-EFAULT);
 
-    inode = new_inode(sb);
+    inode = iget_locked(sb, ino);
     if (!inode)
         return ERR_PTR(-ENOMEM);
+    if (!(inode->i_state & I_NEW))
+        return inode;
+
+    // A free slot, e.g. reached through a stale NFS handle
+    if (!osfs_inode->i_mode) {
+        iget_failed(inode);
+        return ERR_PTR(-ESTALE);
+    }
 
-    inode->i_ino = ino;
-    inode->i_sb = sb;
     inode->i_mode = osfs_inode->i_mode;
     i_uid_write(inode, osfs_inode->i_uid);
     i_gid_write(inode, osfs_inode->i_gid);
@@ -78,7 +222,11 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     inode->__i_mtime = osfs_inode->__i_mtime;
     inode->__i_ctime = osfs_inode->__i_ctime;
     inode->i_size = osfs_inode->i_size;
-    inode->i_blocks = osfs_inode->i_blocks;
+    inode->i_blocks = osfs_vfs_blocks(osfs_inode->i_blocks);
+    set_nlink(inode, osfs_inode->i_links_count);
+    inode->i_generation = osfs_inode->i_generation;
+    // A cache may hold the value from before eviction: count it as queried
+    inode_set_iversion_queried(inode, osfs_inode->i_version);
     // link to internal osfs_inode
     inode->i_private = osfs_inode;
 
@@ -88,43 +236,206 @@ struct inode *osfs_iget(struct super_block *sb, unsigned long ino)
     } else if (S_ISREG(inode->i_mode)) {
         inode->i_op = &osfs_file_inode_operations;
         inode->i_fop = &osfs_file_operations;
+        inode->i_mapping->a_ops = &osfs_aops;
+        mapping_set_large_folios(inode->i_mapping);
+    }
+
+    if ((osfs_inode->i_flags & FS_IMMUTABLE_FL) && osfs_seal_inode(inode, true)) {
+        iget_failed(inode);
+        return ERR_PTR(-ENOMEM);
     }
 
-    // Insert the inode into the inode hash
-    insert_inode_hash(inode);
+    unlock_new_inode(inode);
 
     return inode;
 }
 
+/**
+ * Function: osfs_fold_inode
+ * Description: Copies the attributes the VFS inode owns (timestamps, mode,
+ *              ownership) into the osfs_inode. Timestamp updates only touch
+ *              the VFS inode and mark it dirty; the inode table is written
+ *              here, once per batch, rather than on every change.
+ * Inputs:
+ *   - inode: The inode to fold.
+ * Returns:
+ *   - None.
+ */
+static void osfs_fold_inode(struct inode *inode)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+
+    if (!osfs_inode)
+        return;
+    osfs_inode->i_mode = inode->i_mode;
+    osfs_inode->i_uid = i_uid_read(inode);
+    osfs_inode->i_gid = i_gid_read(inode);
+    osfs_inode->__i_atime = inode_get_atime(inode);
+    osfs_inode->__i_mtime = inode_get_mtime(inode);
+    osfs_inode->__i_ctime = inode_get_ctime(inode);
+    osfs_inode->i_version = inode_peek_iversion(inode);
+}
+
+/**
+ * Function: osfs_write_inode
+ * Description: Writeback of a dirty inode. Also called directly by
+ *              osfs_flush_inodes for the inodes on the dirty list.
+ * Inputs:
+ *   - inode: The dirty inode.
+ *   - wbc: Writeback control (unused, the fold is synchronous).
+ * Returns:
+ *   - 0.
+ */
+int osfs_write_inode(struct inode *inode, struct writeback_control *wbc)
+{
+    osfs_fold_inode(inode);
+    return 0;
+}
+
+/**
+ * Function: osfs_evict_inode
+ * Description: Called when a VFS inode leaves the inode cache: as soon as
+ *              its last reference is dropped once it has no links left,
+ *              otherwise on memory pressure or at unmount. An unlinked
+ *              inode's data blocks and inode number are returned to the free
+ *              pools.
+ * Inputs:
+ *   - inode: The inode being evicted.
+ * Returns:
+ *   - None.
+ */
+void osfs_evict_inode(struct inode *inode)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    uint32_t block, next, i;
+
+    truncate_inode_pages_final(&inode->i_data);
+    clear_inode(inode);
+    osfs_seal_evict(inode);
+    // Folded below if still linked; the flush must not find it again
+    if (!list_empty_careful(&OSFS_I(inode)->i_dirty)) {
+        osfs_spin_lock(&sb_info->dirty_lock, OSFS_LOCK_DIRTY);
+        list_del_init(&OSFS_I(inode)->i_dirty);
+        spin_unlock(&sb_info->dirty_lock);
+    }
+
+    if (!osfs_inode)
+        return;
+    if (inode->i_nlink) {
+        // Dirty timestamps are folded here at the latest
+        osfs_fold_inode(inode);
+        return;
+    }
+
+    // Walk the FAT chain, releasing every block of the file
+    block = osfs_inode->i_block;
+    for (i = 0; i < osfs_inode->i_blocks; i++) {
+        next = *osfs_fat(sb_info, block);
+        osfs_free_data_block(sb_info, block);
+        block = next;
+    }
+    if (osfs_inode->i_xattr_block != OSFS_NO_BLOCK)
+        osfs_free_data_block(sb_info, osfs_inode->i_xattr_block);
+    if (S_ISDIR(osfs_inode->i_mode) && osfs_inode->i_blocks)
+        osfs_place_dir_removed(sb_info, osfs_inode->i_block);
+    memset(osfs_inode, 0, sizeof(*osfs_inode));
+    osfs_put_free_inode(sb_info, inode->i_ino);
+}
+
 /**
  * Function: osfs_alloc_data_block
- * Description: Allocates a free data block from the block bitmap.
+ * Description: Allocates a free data block from the block bitmap, lock free
+ *              in the same way as osfs_get_free_inode. The search starts
+ *              after the last allocated block and wraps once, so filling a
+ *              large file does not rescan the used front of the bitmap.
+ *              Only blocks backed by a chunk are searched; once they are all
+ *              in use the mount takes another chunk from the pool. May sleep.
+ *              Mounts with alloc=log append at the log head instead.
  * Inputs:
  *   - sb_info: The superblock information of the filesystem.
+ *   - goal: The block to start the search at (see place.c).
  *   - block_no: Pointer to store the allocated block number.
  * Returns:
  *   - 0 on successful allocation.
- *   - -ENOSPC if no free data block is available.
+ *   - -ENOSPC if the mount is at its limit or the pool is exhausted.
+ *   - -ENOMEM if a new chunk cannot be allocated.
  */
-int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no)
+int osfs_alloc_data_block_near(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t *block_no)
 {
-    uint32_t i;
+    u64 t0 = local_clock();
+    uint32_t nr_chunks, start, end, i, from;
+    bool counted;
+    int ret;
+
+    if (sb_info->log)
+        return osfs_log_alloc(sb_info, block_no);
 
-    for (i = 0; i < sb_info->block_count; i++) {
-        if (!test_bit(i, sb_info->block_bitmap)) {
-            pr_info("osfs_alloc_data_block: Allocated block %u\n", i);
-            set_bit(i, sb_info->block_bitmap);
-            sb_info->nr_free_blocks--;
-            *block_no = i;
-            return 0;
+    for (;;) {
+        // Pairs with the release in osfs_pool_grow(): chunks[] is valid below end
+        nr_chunks = smp_load_acquire(&sb_info->nr_chunks);
+        end = min_t(uint64_t, sb_info->shared_blocks + (uint64_t)nr_chunks * OSFS_CHUNK_BLOCKS,
+                    sb_info->block_count);
+        start = goal;
+        if (start >= end)
+            start = 0;
+
+        for (i = start;;) {
+            from = i;
+            i = find_next_zero_bit(sb_info->block_bitmap, end, i);
+            this_cpu_add(osfs_stats.alloc[OSFS_ALLOC_BLOCK].scanned, i - from);
+            if (i >= end) {
+                if (!start)
+                    break;
+                // Wrap around for the blocks before the hint
+                end = start;
+                start = i = 0;
+                continue;
+            }
+            counted = osfs_view_begin(sb_info);
+            if (!test_and_set_bit(i, sb_info->block_bitmap)) {
+                osfs_view_end(sb_info, counted);
+                pr_debug("osfs_alloc_data_block: Allocated block %u\n", i);
+                atomic_inc(&osfs_block_chunk(sb_info, i)->live);
+                atomic_dec(&sb_info->nr_free_blocks);
+                WRITE_ONCE(sb_info->block_hint, i + 1);
+                *block_no = i;
+                osfs_alloc_stat(OSFS_ALLOC_BLOCK, t0, false);
+                return 0;
+            }
+            osfs_view_end(sb_info, counted);
+            this_cpu_inc(osfs_stats.alloc[OSFS_ALLOC_BLOCK].retries);
+        }
+
+        ret = osfs_pool_grow(sb_info, nr_chunks);
+        if (ret) {
+            osfs_alloc_stat(OSFS_ALLOC_BLOCK, t0, true);
+            pr_err("osfs_alloc_data_block: No free data block available\n");
+            return ret;
         }
     }
-    pr_err("osfs_alloc_data_block: No free data block available\n");
-    return -ENOSPC;
+}
+
+/**
+ * Function: osfs_alloc_data_block
+ * Description: Allocates a data block with no placement goal: the search
+ *              continues after the last block allocated.
+ */
+int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no)
+{
+    return osfs_alloc_data_block_near(sb_info, READ_ONCE(sb_info->block_hint), block_no);
 }
 
 void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no)
 {
+    bool counted;
+
+    // Blocks of the base stay reserved in an overlay
+    if (osfs_block_shared(sb_info, block_no))
+        return;
+    atomic_dec(&osfs_block_chunk(sb_info, block_no)->live);
+    counted = osfs_view_begin(sb_info);
     clear_bit(block_no, sb_info->block_bitmap);
-    sb_info->nr_free_blocks++;
-}
\ No newline at end of file
+    osfs_view_end(sb_info, counted);
+    atomic_inc(&sb_info->nr_free_blocks);
+}
@@ -0,0 +1,294 @@
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "osfs.h"
+
+/*
+ * Per-mount background jobs. Housekeeping (the periodic inode flush, and
+ * whatever else a mount grows) registers a struct osfs_job instead of
+ * running its own work item or thread. One dispatcher work item per mount
+ * runs the due jobs in priority order on the module's unbound workqueue,
+ * under two limits that keep it out of the way of foreground I/O:
+ *
+ *   - CPU budget: per bg_window_ms window the jobs of a mount may use
+ *     bg_budget_pct percent of one CPU; past that the dispatcher sleeps
+ *     until the next window.
+ *   - Idle detection: OSFS_JOB_IDLE jobs only run once no read or write
+ *     has entered the mount for bg_idle_ms.
+ *
+ * A job callback does one bounded slice of work and returns whether more
+ * is left; long jobs poll osfs_job_should_yield() between items. The
+ * workqueue is WQ_SYSFS, so its nice level and cpumask can be tuned under
+ * /sys/devices/virtual/workqueue/osfs_bg.
+ */
+
+static unsigned int bg_budget_pct = 10;
+module_param(bg_budget_pct, uint, 0644);
+MODULE_PARM_DESC(bg_budget_pct, "Percent of one CPU a mount's background jobs may use per window");
+
+static unsigned int bg_window_ms = 100;
+module_param(bg_window_ms, uint, 0644);
+MODULE_PARM_DESC(bg_window_ms, "Length of the background CPU budget window in milliseconds");
+
+static unsigned int bg_slice_us = 1000;
+module_param(bg_slice_us, uint, 0644);
+MODULE_PARM_DESC(bg_slice_us, "Time after which a background job is asked to yield, in microseconds");
+
+static unsigned int bg_idle_ms = 200;
+module_param(bg_idle_ms, uint, 0644);
+MODULE_PARM_DESC(bg_idle_ms, "Milliseconds without foreground I/O before a mount counts as idle");
+
+static struct workqueue_struct *osfs_bg_wq;
+
+static const char * const osfs_job_prio_names[OSFS_JOB_NR_PRIO] = {
+    [OSFS_JOB_HIGH] = "high",
+    [OSFS_JOB_NORMAL] = "normal",
+    [OSFS_JOB_IDLE] = "idle",
+};
+
+static inline unsigned long osfs_idle_at(struct osfs_sb_info *sb_info)
+{
+    return READ_ONCE(sb_info->fg_last) + msecs_to_jiffies(bg_idle_ms);
+}
+
+/**
+ * Function: osfs_jobs_pick
+ * Description: Selects the due job of the highest priority. Callers hold
+ *              jobs->lock.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - now: The current jiffies.
+ *   - next: Set to when the earliest job that is not due becomes due.
+ * Returns:
+ *   - The job to run, or NULL.
+ */
+static struct osfs_job *osfs_jobs_pick(struct osfs_sb_info *sb_info, unsigned long now, unsigned long *next)
+{
+    struct osfs_job *job, *best = NULL;
+    unsigned long due;
+
+    *next = now + MAX_JIFFY_OFFSET;
+    list_for_each_entry(job, &sb_info->jobs.list, node) {
+        if (!job->queued)
+            continue;
+        due = job->due;
+        if (job->prio == OSFS_JOB_IDLE && time_before(due, osfs_idle_at(sb_info)))
+            due = osfs_idle_at(sb_info);
+        if (time_after(due, now)) {
+            if (time_before(due, *next))
+                *next = due;
+            continue;
+        }
+        if (!best || job->prio < best->prio)
+            best = job;
+    }
+    return best;
+}
+
+/**
+ * Function: osfs_jobs_work
+ * Description: The dispatcher of a mount. Runs due jobs until none is left
+ *              or the window's budget is spent, then rearms itself for the
+ *              next due job or window.
+ */
+static void osfs_jobs_work(struct work_struct *work)
+{
+    struct osfs_jobs *jobs = container_of(to_delayed_work(work), struct osfs_jobs, work);
+    struct osfs_sb_info *sb_info = container_of(jobs, struct osfs_sb_info, jobs);
+    u64 window_ns = (u64)bg_window_ms * NSEC_PER_MSEC;
+    u64 budget_ns = div_u64(window_ns * min(bg_budget_pct, 100U), 100);
+    unsigned long now, next;
+    struct osfs_job *job;
+    u64 start, t;
+    bool more;
+
+    for (;;) {
+        t = local_clock();
+        if (t - jobs->window_start >= window_ns) {
+            jobs->window_start = t;
+            jobs->window_used = 0;
+        }
+        now = jiffies;
+        if (jobs->window_used >= budget_ns) {
+            jobs->throttled++;
+            next = now + max(nsecs_to_jiffies(jobs->window_start + window_ns - t), 1UL);
+            break;
+        }
+
+        next = now + MAX_JIFFY_OFFSET;
+        osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+        job = jobs->stopped ? NULL : osfs_jobs_pick(sb_info, now, &next);
+        if (job)
+            job->queued = false;
+        spin_unlock(&jobs->lock);
+        if (!job)
+            break;
+
+        start = local_clock();
+        jobs->slice_end = start + (u64)bg_slice_us * NSEC_PER_USEC;
+        more = job->fn(sb_info, job);
+        t = local_clock() - start;
+        jobs->window_used += t;
+        job->runs++;
+        job->runtime_ns += t;
+        job->max_ns = max(job->max_ns, t);
+
+        osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+        // A kick during the run has already requeued it
+        if (!job->queued && (more || job->interval)) {
+            job->queued = true;
+            job->due = more ? jiffies : jiffies + job->interval;
+        }
+        spin_unlock(&jobs->lock);
+        cond_resched();
+    }
+
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    // A kick while we ran left the work pending, which this does not delay
+    if (!jobs->stopped && next != now + MAX_JIFFY_OFFSET)
+        queue_delayed_work(osfs_bg_wq, &jobs->work, time_after(next, now) ? next - now : 0);
+    spin_unlock(&jobs->lock);
+}
+
+/**
+ * Function: osfs_job_should_yield
+ * Description: Whether a running job has used up its slice, or foreground
+ *              I/O has started on an IDLE job's mount. The job should then
+ *              return true so the dispatcher reschedules it.
+ */
+bool osfs_job_should_yield(struct osfs_sb_info *sb_info, struct osfs_job *job)
+{
+    if (local_clock() >= sb_info->jobs.slice_end)
+        return true;
+    return job->prio == OSFS_JOB_IDLE && time_before(jiffies, osfs_idle_at(sb_info));
+}
+
+/**
+ * Function: osfs_job_add
+ * Description: Registers a job on a mount. A job with an interval runs
+ *              first after one interval; other jobs only when kicked. Jobs
+ *              only run once the dispatcher is resumed.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - job: The job, with name, prio, interval and fn set. It must stay
+ *     allocated until osfs_jobs_stop().
+ */
+void osfs_job_add(struct osfs_sb_info *sb_info, struct osfs_job *job)
+{
+    struct osfs_jobs *jobs = &sb_info->jobs;
+
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    job->queued = job->interval != 0;
+    job->due = jiffies + job->interval;
+    list_add_tail(&job->node, &jobs->list);
+    spin_unlock(&jobs->lock);
+}
+
+/**
+ * Function: osfs_job_kick
+ * Description: Makes a job due now, e.g. when deferred work is queued.
+ *              Cheap enough for hot paths: it does nothing if the job is
+ *              already due.
+ */
+void osfs_job_kick(struct osfs_sb_info *sb_info, struct osfs_job *job)
+{
+    struct osfs_jobs *jobs = &sb_info->jobs;
+    unsigned long now = jiffies;
+
+    if (READ_ONCE(job->queued) && !time_after(READ_ONCE(job->due), now))
+        return;
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    job->queued = true;
+    job->due = now;
+    if (!jobs->stopped)
+        mod_delayed_work(osfs_bg_wq, &jobs->work, 0);
+    spin_unlock(&jobs->lock);
+}
+
+/**
+ * Function: osfs_jobs_stop
+ * Description: Parks the dispatcher of a mount and waits for a running
+ *              job to return. Used by freeze and unmount.
+ */
+void osfs_jobs_stop(struct osfs_sb_info *sb_info)
+{
+    struct osfs_jobs *jobs = &sb_info->jobs;
+
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    jobs->stopped = true;
+    spin_unlock(&jobs->lock);
+    cancel_delayed_work_sync(&jobs->work);
+}
+
+/**
+ * Function: osfs_jobs_resume
+ * Description: Restarts the dispatcher after osfs_jobs_stop(), and starts
+ *              it at mount. Due jobs run right away.
+ */
+void osfs_jobs_resume(struct osfs_sb_info *sb_info)
+{
+    struct osfs_jobs *jobs = &sb_info->jobs;
+
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    jobs->stopped = false;
+    mod_delayed_work(osfs_bg_wq, &jobs->work, 0);
+    spin_unlock(&jobs->lock);
+}
+
+/**
+ * Function: osfs_jobs_init
+ * Description: Initializes the job list of a new mount, stopped until the
+ *              first osfs_jobs_resume().
+ */
+void osfs_jobs_init(struct osfs_sb_info *sb_info)
+{
+    struct osfs_jobs *jobs = &sb_info->jobs;
+
+    INIT_DELAYED_WORK(&jobs->work, osfs_jobs_work);
+    spin_lock_init(&jobs->lock);
+    INIT_LIST_HEAD(&jobs->list);
+    jobs->stopped = true;
+    sb_info->fg_last = jiffies;
+}
+
+/**
+ * Function: osfs_jobs_show
+ * Description: The jobs file of a mount: one line per job with its
+ *              priority, runs, total and longest run time, and whether it
+ *              is due; then how often the budget throttled the mount.
+ */
+static int osfs_jobs_show(struct seq_file *m, void *v)
+{
+    struct osfs_sb_info *sb_info = m->private;
+    struct osfs_jobs *jobs = &sb_info->jobs;
+    struct osfs_job *job;
+
+    seq_puts(m, "# job prio runs runtime_ns max_ns queued\n");
+    osfs_spin_lock(&jobs->lock, OSFS_LOCK_JOBS);
+    list_for_each_entry(job, &jobs->list, node)
+        seq_printf(m, "%s %s %llu %llu %llu %d\n", job->name, osfs_job_prio_names[job->prio],
+                   job->runs, job->runtime_ns, job->max_ns, job->queued);
+    spin_unlock(&jobs->lock);
+    seq_printf(m, "throttled %llu\n", jobs->throttled);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(osfs_jobs);
+
+/**
+ * Function: osfs_jobs_register
+ * Description: Adds the jobs file to the mount's debugfs directory.
+ */
+void osfs_jobs_register(struct osfs_sb_info *sb_info)
+{
+    debugfs_create_file("jobs", 0400, sb_info->debugfs, sb_info, &osfs_jobs_fops);
+}
+
+int osfs_jobs_module_init(void)
+{
+    osfs_bg_wq = alloc_workqueue("osfs_bg", WQ_UNBOUND | WQ_SYSFS, 0);
+    return osfs_bg_wq ? 0 : -ENOMEM;
+}
+
+void osfs_jobs_module_exit(void)
+{
+    destroy_workqueue(osfs_bg_wq);
+}
@@ -0,0 +1,412 @@
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "osfs.h"
+
+/*
+ * Log-structured allocation (alloc=log). The private block range is split
+ * into segments, one per chunk. New blocks are appended at the log head,
+ * which only moves forward through the segment it has open; once that is
+ * full the head opens a clean segment (no live blocks), backs a new one
+ * from the pool, or, when neither is possible, fills the holes of the
+ * emptiest segment. Blocks freed behind the head are not reused until
+ * their segment is reopened, so a segment fills in address order and
+ * files written together sit together.
+ *
+ * The cleaner, an idle-priority background job, keeps clean segments
+ * available: it picks the segment with the fewest live blocks, below
+ * log_clean_pct percent, and appends every live block in it to the head,
+ * relinking the chain that points at it. The segment is then clean.
+ *
+ * Blocks are memory, so overwrites stay in place: copying a block to the
+ * head on every write would only add a memcpy. Blocks of sealed files
+ * are not moved, since their maps and mappings point at them.
+ */
+
+static unsigned int log_clean_pct = 25;
+module_param(log_clean_pct, uint, 0644);
+MODULE_PARM_DESC(log_clean_pct, "Live blocks, in percent of a segment, below which the cleaner evacuates it");
+
+#define OSFS_LOG_NO_SEG U32_MAX
+
+static inline uint32_t osfs_log_seg(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    return (block - sb_info->shared_blocks) >> OSFS_CHUNK_SHIFT;
+}
+
+static inline uint32_t osfs_log_seg_start(struct osfs_sb_info *sb_info, uint32_t seg)
+{
+    return sb_info->shared_blocks + (seg << OSFS_CHUNK_SHIFT);
+}
+
+/**
+ * Function: osfs_log_seg_size
+ * Description: Blocks in a segment; the last one may be cut short by the
+ *              blocks= limit.
+ */
+static inline uint32_t osfs_log_seg_size(struct osfs_sb_info *sb_info, uint32_t seg)
+{
+    return min(OSFS_CHUNK_BLOCKS, sb_info->block_count - osfs_log_seg_start(sb_info, seg));
+}
+
+// Maintained by every allocator, see osfs_free_data_block()
+static inline atomic_t *osfs_log_live(struct osfs_sb_info *sb_info, uint32_t seg)
+{
+    return &sb_info->chunks[seg]->live;
+}
+
+/**
+ * Function: osfs_log_open
+ * Description: Chooses the segment the head moves to. Callers hold
+ *              log_lock.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - nr_chunks: The backed segments.
+ *   - may_grow: Whether another chunk may be taken from the pool.
+ * Returns:
+ *   - The segment.
+ *   - -EAGAIN if no segment is clean and the mount should grow.
+ *   - -ENOSPC if every segment is full.
+ */
+static int osfs_log_open(struct osfs_sb_info *sb_info, uint32_t nr_chunks, bool may_grow)
+{
+    uint32_t cur = sb_info->log_seg, victim = READ_ONCE(sb_info->log_victim);
+    uint32_t seg, live, best = OSFS_LOG_NO_SEG, best_live = U32_MAX;
+
+    for (seg = 0; seg < nr_chunks; seg++) {
+        if (seg == victim)
+            continue;
+        live = atomic_read(osfs_log_live(sb_info, seg));
+        if (live >= osfs_log_seg_size(sb_info, seg))
+            continue;
+        if (!live && seg != cur)
+            return seg;
+        if (live < best_live) {
+            best = seg;
+            best_live = live;
+        }
+    }
+    if (may_grow && (uint64_t)nr_chunks * OSFS_CHUNK_BLOCKS < sb_info->block_count - sb_info->shared_blocks)
+        return -EAGAIN;
+
+    // Out of clean segments: fill holes, and have the cleaner make more
+    osfs_job_kick(sb_info, &sb_info->clean_job);
+    if (best != OSFS_LOG_NO_SEG)
+        return best;
+    if (victim != OSFS_LOG_NO_SEG && atomic_read(osfs_log_live(sb_info, victim)) <
+                                     osfs_log_seg_size(sb_info, victim)) {
+        // The victim's free blocks are the last ones; cleaning it is moot
+        WRITE_ONCE(sb_info->log_victim, OSFS_LOG_NO_SEG);
+        return victim;
+    }
+    return -ENOSPC;
+}
+
+/**
+ * Function: osfs_log_alloc
+ * Description: osfs_alloc_data_block() in log mode: appends a block at the
+ *              log head. Appends are serialized by log_lock; frees still
+ *              only clear their bit. May sleep to grow the mount.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if the mount is at its limit or the pool is exhausted.
+ *   - -ENOMEM if a new chunk cannot be allocated.
+ */
+int osfs_log_alloc(struct osfs_sb_info *sb_info, uint32_t *block_no)
+{
+    u64 t0 = local_clock();
+    uint32_t nr_chunks, head, seg, end, i;
+    bool may_grow = true, counted;
+    int ret;
+
+    osfs_spin_lock(&sb_info->log_lock, OSFS_LOCK_ALLOC);
+    for (;;) {
+        // Pairs with the release in osfs_pool_grow()
+        nr_chunks = smp_load_acquire(&sb_info->nr_chunks);
+        head = sb_info->log_head;
+        seg = sb_info->log_seg;
+        // The head stays in its segment; once that is full, open another
+        if (seg < nr_chunks) {
+            end = osfs_log_seg_start(sb_info, seg) + osfs_log_seg_size(sb_info, seg);
+            i = find_next_zero_bit(sb_info->block_bitmap, end, head);
+            this_cpu_add(osfs_stats.alloc[OSFS_ALLOC_BLOCK].scanned, i - head);
+            if (i < end) {
+                counted = osfs_view_begin(sb_info);
+                set_bit(i, sb_info->block_bitmap);
+                osfs_view_end(sb_info, counted);
+                atomic_inc(osfs_log_live(sb_info, seg));
+                sb_info->log_head = i + 1;
+                spin_unlock(&sb_info->log_lock);
+                atomic_dec(&sb_info->nr_free_blocks);
+                *block_no = i;
+                osfs_alloc_stat(OSFS_ALLOC_BLOCK, t0, false);
+                return 0;
+            }
+        }
+
+        ret = osfs_log_open(sb_info, nr_chunks, may_grow);
+        if (ret >= 0) {
+            WRITE_ONCE(sb_info->log_seg, ret);
+            sb_info->log_head = osfs_log_seg_start(sb_info, ret);
+            sb_info->log_opened++;
+            continue;
+        }
+        spin_unlock(&sb_info->log_lock);
+        if (ret == -EAGAIN) {
+            ret = osfs_pool_grow(sb_info, nr_chunks);
+            // The pool is full: settle for the holes of used segments
+            if (ret == -ENOSPC) {
+                may_grow = false;
+                ret = 0;
+            }
+        }
+        if (ret) {
+            osfs_alloc_stat(OSFS_ALLOC_BLOCK, t0, true);
+            pr_err("osfs_log_alloc: No free data block available\n");
+            return ret;
+        }
+        osfs_spin_lock(&sb_info->log_lock, OSFS_LOCK_ALLOC);
+    }
+}
+
+/**
+ * Function: osfs_log_pick_victim
+ * Description: The segment with the fewest live blocks under the
+ *              log_clean_pct threshold, other than the head's. Callers hold
+ *              log_lock, so the head cannot open it meanwhile.
+ */
+static uint32_t osfs_log_pick_victim(struct osfs_sb_info *sb_info)
+{
+    uint32_t nr_chunks = smp_load_acquire(&sb_info->nr_chunks);
+    uint32_t cur = sb_info->log_seg, seg, live;
+    uint32_t best = OSFS_LOG_NO_SEG, best_live = U32_MAX;
+
+    for (seg = 0; seg < nr_chunks; seg++) {
+        if (seg == cur)
+            continue;
+        live = atomic_read(osfs_log_live(sb_info, seg));
+        if (!live || live * 100ULL > (uint64_t)osfs_log_seg_size(sb_info, seg) * log_clean_pct)
+            continue;
+        if (live < best_live) {
+            best = seg;
+            best_live = live;
+        }
+    }
+    return best;
+}
+
+static inline bool osfs_log_in_victim(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    uint32_t victim = READ_ONCE(sb_info->log_victim);
+
+    return victim != OSFS_LOG_NO_SEG && !osfs_block_shared(sb_info, block) &&
+           osfs_log_seg(sb_info, block) == victim;
+}
+
+/**
+ * Function: osfs_log_hits
+ * Description: Unlocked check whether an inode has blocks in the victim,
+ *              so only those inodes are looked up and locked. A racing
+ *              change can only make it miss a block, which stays live in
+ *              the victim.
+ */
+static bool osfs_log_hits(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    uint32_t nr = READ_ONCE(osfs_inode->i_blocks), block = READ_ONCE(osfs_inode->i_block), i;
+    uint32_t xattr = READ_ONCE(osfs_inode->i_xattr_block);
+    // A racing change may leave stale entries in the walk: stay on backed
+    // blocks
+    uint64_t end = sb_info->shared_blocks + ((uint64_t)smp_load_acquire(&sb_info->nr_chunks) << OSFS_CHUNK_SHIFT);
+
+    if (xattr < end && osfs_log_in_victim(sb_info, xattr))
+        return true;
+    for (i = 0; i < nr && block < end; i++) {
+        if (osfs_log_in_victim(sb_info, block))
+            return true;
+        block = READ_ONCE(*osfs_fat(sb_info, block));
+    }
+    return false;
+}
+
+/**
+ * Function: osfs_log_move
+ * Description: Appends a copy of a block at the head and frees the
+ *              original. *link is the pointer to the block: i_block, a FAT
+ *              entry or i_xattr_block.
+ * Returns:
+ *   - 0 on success, or the error of osfs_log_alloc().
+ */
+static int osfs_log_move(struct inode *inode, uint32_t *link, bool small)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    uint32_t old = *link, new;
+    bool counted;
+    int ret;
+
+    ret = osfs_log_alloc(sb_info, &new);
+    if (ret)
+        return ret;
+    memcpy(osfs_block_addr(sb_info, new), osfs_block_addr(sb_info, old), BLOCK_SIZE);
+
+    // osfs_read_small() reads block 0 of a small file without inode_lock
+    if (small)
+        write_seqcount_begin(&OSFS_I(inode)->i_seq);
+    counted = osfs_view_begin(sb_info);
+    *osfs_fat(sb_info, new) = *osfs_fat(sb_info, old);
+    smp_store_release(link, new);
+    osfs_view_end(sb_info, counted);
+    osfs_free_data_block(sb_info, old);
+    if (small)
+        write_seqcount_end(&OSFS_I(inode)->i_seq);
+    sb_info->log_moved++;
+    return 0;
+}
+
+/**
+ * Function: osfs_log_evacuate
+ * Description: Moves the blocks an inode has in the victim segment.
+ * Returns:
+ *   - 0 on success, including when the inode is gone or sealed.
+ *   - An error of osfs_log_alloc(), which ends the cleaning pass.
+ */
+static int osfs_log_evacuate(struct osfs_sb_info *sb_info, uint32_t ino)
+{
+    struct osfs_inode *osfs_inode;
+    uint32_t *link, old, i;
+    struct inode *inode;
+    int ret = 0;
+
+    inode = osfs_iget(sb_info->sb, ino);
+    if (IS_ERR(inode))
+        return 0;
+    osfs_inode_lock(inode);
+    osfs_inode = inode->i_private;
+    if (IS_IMMUTABLE(inode) || !osfs_inode->i_mode)
+        goto out;
+
+    if (osfs_inode->i_xattr_block != OSFS_NO_BLOCK && osfs_log_in_victim(sb_info, osfs_inode->i_xattr_block)) {
+        ret = osfs_log_move(inode, &osfs_inode->i_xattr_block, false);
+        if (ret)
+            goto out;
+    }
+    link = &osfs_inode->i_block;
+    for (i = 0; i < osfs_inode->i_blocks; i++) {
+        if (osfs_log_in_victim(sb_info, *link)) {
+            old = *link;
+            ret = osfs_log_move(inode, link, !i && osfs_inode->i_size <= BLOCK_SIZE);
+            if (ret)
+                break;
+            // A directory is counted in the region of its block
+            if (!i && S_ISDIR(osfs_inode->i_mode)) {
+                osfs_place_dir_removed(sb_info, old);
+                osfs_place_dir_added(sb_info, *link);
+            }
+        }
+        link = osfs_fat(sb_info, *link);
+        if (!(i & 1023))
+            cond_resched();
+    }
+    // The cursor may name a moved block
+    WRITE_ONCE(OSFS_I(inode)->i_cursor, 0);
+out:
+    inode_unlock(inode);
+    iput(inode);
+    return ret;
+}
+
+/**
+ * Function: osfs_log_clean
+ * Description: The cleaner job. Scans the inode table for blocks in the
+ *              victim segment and moves them, resuming where the last
+ *              slice stopped. A base shared by overlays is left alone,
+ *              since they map its blocks by number.
+ * Returns:
+ *   - Whether more cleaning may be possible.
+ */
+static bool osfs_log_clean(struct osfs_sb_info *sb_info, struct osfs_job *job)
+{
+    struct osfs_inode *table = sb_info->inode_table;
+    uint32_t ino;
+
+    if (sb_rdonly(sb_info->sb) || atomic_read(&sb_info->nr_overlays)) {
+        WRITE_ONCE(sb_info->log_victim, OSFS_LOG_NO_SEG);
+        return false;
+    }
+    if (sb_info->log_victim == OSFS_LOG_NO_SEG) {
+        osfs_spin_lock(&sb_info->log_lock, OSFS_LOCK_ALLOC);
+        WRITE_ONCE(sb_info->log_victim, osfs_log_pick_victim(sb_info));
+        spin_unlock(&sb_info->log_lock);
+        if (sb_info->log_victim == OSFS_LOG_NO_SEG)
+            return false;
+        sb_info->log_scan = ROOT_INODE;
+    }
+
+    while ((ino = sb_info->log_scan) < sb_info->inode_count) {
+        if (osfs_job_should_yield(sb_info, job))
+            return true;
+        sb_info->log_scan++;
+        if (!test_bit(ino, sb_info->inode_bitmap) || !osfs_log_hits(sb_info, &table[ino]))
+            continue;
+        if (osfs_log_evacuate(sb_info, ino)) {
+            // No room to move into; try again later
+            WRITE_ONCE(sb_info->log_victim, OSFS_LOG_NO_SEG);
+            return false;
+        }
+    }
+    // Also set when osfs_log_open() gave the victim back to the head
+    if (sb_info->log_victim != OSFS_LOG_NO_SEG)
+        sb_info->log_cleaned++;
+    WRITE_ONCE(sb_info->log_victim, OSFS_LOG_NO_SEG);
+    return true;
+}
+
+/**
+ * Function: osfs_log_show
+ * Description: The log file of a log-mode mount: head, live blocks per
+ *              backed segment, and cleaner totals.
+ */
+static int osfs_log_show(struct seq_file *m, void *v)
+{
+    struct osfs_sb_info *sb_info = m->private;
+    uint32_t nr_chunks = smp_load_acquire(&sb_info->nr_chunks), seg;
+
+    seq_printf(m, "segment %d\n", (int)READ_ONCE(sb_info->log_seg));
+    seq_printf(m, "head %d\n", (int)READ_ONCE(sb_info->log_head));
+    seq_printf(m, "victim %d\n", (int)READ_ONCE(sb_info->log_victim));
+    seq_printf(m, "opened %llu\ncleaned %llu\nmoved %llu\n", sb_info->log_opened,
+               sb_info->log_cleaned, sb_info->log_moved);
+    seq_puts(m, "# segment live size\n");
+    for (seg = 0; seg < nr_chunks; seg++)
+        seq_printf(m, "%u %d %u\n", seg, atomic_read(osfs_log_live(sb_info, seg)),
+                   osfs_log_seg_size(sb_info, seg));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(osfs_log);
+
+/**
+ * Function: osfs_log_init
+ * Description: Sets up log mode on a new mount, before its first block is
+ *              allocated.
+ */
+void osfs_log_init(struct osfs_sb_info *sb_info)
+{
+    sb_info->log = true;
+    spin_lock_init(&sb_info->log_lock);
+    sb_info->log_seg = OSFS_LOG_NO_SEG;
+    sb_info->log_head = OSFS_NO_BLOCK;
+    sb_info->log_victim = OSFS_LOG_NO_SEG;
+    sb_info->clean_job.name = "clean";
+    sb_info->clean_job.prio = OSFS_JOB_IDLE;
+    sb_info->clean_job.interval = HZ;
+    sb_info->clean_job.fn = osfs_log_clean;
+    osfs_job_add(sb_info, &sb_info->clean_job);
+}
+
+/**
+ * Function: osfs_log_register
+ * Description: Adds the log file to the mount's debugfs directory.
+ */
+void osfs_log_register(struct osfs_sb_info *sb_info)
+{
+    if (sb_info->log)
+        debugfs_create_file("log", 0400, sb_info->debugfs, sb_info, &osfs_log_fops);
+}
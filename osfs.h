@@ -3,29 +3,101 @@
 
 #include <linux/types.h>      // Include basic type definitions
 #include <linux/fs.h>
+#include <linux/iversion.h>
 #include <linux/bitmap.h>    // For bitmap operations
 #include <linux/time.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/string.h>
 #include <linux/module.h>
+#include <linux/jump_label.h>
+#include <linux/list_bl.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/workqueue.h>
+#include "osfs_uapi.h"
 
 #define OSFS_MAGIC 0x051AB520
 //#define BLOCK_SIZE 4096       // Each data block size is 4KB
-#define INODE_COUNT 20         // Maximum of 20 inodes in the filesystem
-#define DATA_BLOCK_COUNT 20    // Assume there are 20 data blocks
-#define FAT_COUNT (DATA_BLOCK_COUNT)
-#define FAT_SIZE (FAT_COUNT * sizeof(uint32_t))
+#define INODE_COUNT 20         // Default number of inodes (inodes= mount option)
+#define DATA_BLOCK_COUNT 20    // Default block limit (blocks= mount option)
 #define MAX_FILENAME_LEN 255
 #define MAX_DIR_ENTRIES (BLOCK_SIZE / sizeof(struct osfs_dir_entry))
 
-#define BITMAP_SIZE(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+// Block numbers (FAT entries, i_block) are 32-bit indices into the mount's
+// data area, while sizes and byte offsets are 64-bit. The free counts are
+// atomic_t, which bounds a mount at INT_MAX blocks (2 TiB of 1K blocks).
+#define OSFS_MAX_BLOCKS INT_MAX
+#define OSFS_NAME_LEN 32        // Instance names (name= and base= mount options)
+
+// Data blocks live in 2 MiB chunks drawn from the module-wide pool (pool.c)
+#define OSFS_CHUNK_SHIFT (21 - BLOCK_SIZE_BITS)
+#define OSFS_CHUNK_BLOCKS (1U << OSFS_CHUNK_SHIFT)
+#define OSFS_CHUNK_MASK (OSFS_CHUNK_BLOCKS - 1)
+#define OSFS_CHUNK_FAT_SIZE PAGE_ALIGN(OSFS_CHUNK_BLOCKS * sizeof(uint32_t))
+
+/**
+ * Struct: osfs_chunk
+ * Description: A run of data blocks and their FAT entries.
+ */
+struct osfs_chunk {
+    void *data;                 // OSFS_CHUNK_BLOCKS blocks
+    uint32_t *fat;              // FAT entries of the chunk's blocks, page-aligned
+    struct list_head list;      // Pool cache of released chunks
+    atomic_t live;              // Blocks in use
+    atomic_t dirs;              // Directories whose block is here (place.c)
+};
+
+enum osfs_job_prio {
+    OSFS_JOB_HIGH,
+    OSFS_JOB_NORMAL,
+    OSFS_JOB_IDLE,          // Only while the mount has no foreground I/O
+    OSFS_JOB_NR_PRIO,
+};
+
+struct osfs_sb_info;
+
+/**
+ * Struct: osfs_job
+ * Description: A background job of a mount (jobs.c).
+ */
+struct osfs_job {
+    const char *name;
+    enum osfs_job_prio prio;
+    unsigned long interval;     // Jiffies between periodic runs, 0 if only kicked
+    // Does one slice of work; returns whether more is left
+    bool (*fn)(struct osfs_sb_info *sb_info, struct osfs_job *job);
+    // Owned by jobs.c
+    struct list_head node;
+    unsigned long due;
+    bool queued;
+    u64 runs;
+    u64 runtime_ns;
+    u64 max_ns;
+};
+
+/**
+ * Struct: osfs_jobs
+ * Description: The job dispatcher of a mount.
+ */
+struct osfs_jobs {
+    struct delayed_work work;
+    spinlock_t lock;            // Guards the list and the queued/due state
+    struct list_head list;
+    bool stopped;               // Frozen or unmounting
+    u64 window_start;           // Budget window, local_clock() ns
+    u64 window_used;
+    u64 slice_end;              // Deadline of the running job
+    u64 throttled;              // Times the budget deferred the jobs
+};
 
-// Calculate the size of the bitmap (in units of unsigned long)
-#define INODE_BITMAP_SIZE BITMAP_SIZE(INODE_COUNT)
-#define BLOCK_BITMAP_SIZE BITMAP_SIZE(DATA_BLOCK_COUNT)
+#define BITMAP_SIZE(bits) (((bits) + BITS_PER_LONG - 1) / BITS_PER_LONG)
 
 #define ROOT_INODE 1            // Define the root inode as 1
+#define OSFS_LINK_MAX 65000     // i_links_count is 16 bits wide
 
 /**
  * Struct: osfs_sb_info
@@ -35,14 +107,48 @@ struct osfs_sb_info {
     uint32_t magic;              // Magic number to identify the filesystem
     uint32_t block_size;         // Size of each data block
     uint32_t inode_count;        // Total number of inodes
-    uint32_t block_count;        // Total number of data blocks
-    uint32_t nr_free_inodes;     // Number of free inodes
-    uint32_t nr_free_blocks;     // Number of free data blocks
+    uint32_t block_count;        // Block limit, including an overlay's shared blocks
+    atomic_t nr_free_inodes;     // Number of free inodes
+    atomic_t nr_free_blocks;     // Number of free data blocks
+    uint32_t block_hint;         // Where the next block search starts
+    atomic_t next_generation;    // Source of osfs_inode.i_generation
     unsigned long *inode_bitmap; // Pointer to the inode bitmap
     unsigned long *block_bitmap; // Pointer to the data block bitmap
-    uint32_t *fat;               // Pointer to the file allocation table
+    uint32_t *fat;               // FAT of an overlay's shared blocks, see osfs_fat()
     void *inode_table;           // Pointer to the inode table
-    void *data_blocks;           // Pointer to the data blocks area
+    struct osfs_chunk **chunks;  // Chunks backing the private blocks, in order
+    uint32_t nr_chunks;          // Chunks backed so far (pool.c)
+    uint32_t reserved_chunks;    // Chunks guaranteed by reserve=
+    struct mutex chunk_lock;     // Serializes osfs_pool_grow()
+    struct list_head teardown;   // Queued for the teardown worker (pool.c)
+    struct osfs_view_header *view; // Header page of the layout views (view.c)
+    atomic_t view_users;         // Open views; changes are counted while set
+    struct dentry *debugfs;      // Per-mount debugfs directory
+    struct hlist_bl_head *dir_index; // Directory index buckets (dirindex.c)
+    uint32_t dir_index_size;     // Number of buckets, a power of two
+    struct super_block *sb;      // Back pointer for background work
+    struct osfs_jobs jobs;       // Background jobs (jobs.c)
+    struct osfs_job flush_job;   // Periodic fold of dirty inodes (super.c)
+    spinlock_t dirty_lock;       // Guards dirty_list
+    struct list_head dirty_list; // Inodes dirtied since their last fold
+    unsigned long fg_last;       // jiffies of the last foreground read or write
+    bool log;                    // alloc=log: log-structured allocation (log.c)
+    spinlock_t log_lock;         // Serializes appends at the log head
+    uint32_t log_seg;            // Segment the head appends to, or U32_MAX
+    uint32_t log_head;           // Next block to append in log_seg
+    uint32_t log_victim;         // Segment being cleaned, or U32_MAX
+    uint32_t log_scan;           // Next inode the cleaner looks at
+    u64 log_opened;              // Segments opened by the head
+    u64 log_cleaned;             // Segments evacuated by the cleaner
+    u64 log_moved;               // Blocks moved by the cleaner
+    struct osfs_job clean_job;   // The log cleaner
+    refcount_t refs;             // Mount plus overlays sharing our data blocks
+    struct list_head instance;   // Named instances (overlay.c)
+    char name[OSFS_NAME_LEN];
+    struct osfs_sb_info *base;   // Read-only base of an overlay, or NULL
+    uint32_t shared_blocks;      // Blocks [0, shared_blocks) live in the base
+    atomic_t nr_overlays;        // Overlays using this mount as their base
+    bool writable;               // A remount read-write is under way
 };
 
 /**
@@ -54,14 +160,33 @@ struct osfs_dir_entry {
     uint32_t inode_no;               // Corresponding inode number
 };
 
+/**
+ * Struct: osfs_dindex_entry
+ * Description: Directory index entry (dirindex.c), one per directory entry.
+ */
+struct osfs_dindex_entry {
+    struct hlist_bl_node node;
+    struct rcu_head rcu;
+    uint32_t dir;           // Parent directory inode number
+    uint32_t hash;          // Hash of (dir, name), selects the bucket
+    uint32_t ino;           // Child inode number
+    uint16_t slot;          // Position of the dirent in the directory block
+    uint8_t name_len;
+    char name[];
+};
+
+#define OSFS_NO_BLOCK ((uint32_t)~0U)  // Unset block pointer
+#define OSFS_XATTR_INLINE_SIZE 128      // Per-inode inline xattr area
+#define OSFS_XATTR_INLINE_MAX_VALUE 64  // Larger values always go to the spill block
+
 /**
  * Struct: osfs_inode
  * Description: Filesystem-specific inode structure.
  */
 struct osfs_inode {
     uint32_t i_ino;                     // Inode number
-    uint32_t i_size;                    // File size in bytes
     uint32_t i_blocks;                  // Number of blocks occupied by the file
+    uint64_t i_size;                    // File size in bytes
     uint16_t i_mode;                    // File mode (permissions and type)
     uint16_t i_links_count;             // Number of hard links
     uint32_t i_uid;                     // User ID of owner
@@ -70,16 +195,402 @@ struct osfs_inode {
     struct timespec64 __i_mtime;        // Last modification time
     struct timespec64 __i_ctime;        // Creation time
     uint32_t i_block;                   // Simplified handling, single data block pointer
+    uint32_t i_generation;              // Bumped on every reuse of the inode number
+    uint32_t i_parent;                  // Parent directory, for NFS reconnection
+    uint32_t i_xattr_block;             // Spill block for large xattrs, or OSFS_NO_BLOCK
+    uint32_t i_flags;                   // FS_*_FL inode flags, see seal.c
+    uint64_t i_version;                 // Change counter, kept across eviction
+    uint16_t i_xattr_inline_used;       // Bytes used in i_xattr_inline
+    uint8_t i_xattr_inline[OSFS_XATTR_INLINE_SIZE]; // Small xattrs, see xattr.c
+};
+
+/**
+ * Struct: osfs_inode_info
+ * Description: In-memory inode, the VFS inode plus osfs private state.
+ */
+struct osfs_inode_info {
+    u64 i_cursor;               // Last FAT position looked up, see osfs_file_block()
+    seqcount_rwsem_t i_seq;     // Guards the lockless small-file read in osfs_read_small()
+    struct osfs_seal_map __rcu *i_map; // Block map while sealed (seal.c)
+    struct list_head i_dirty;   // On sb_info->dirty_list, see osfs_dirty_inode()
+    struct inode vfs_inode;
 };
 
+static inline struct osfs_inode_info *OSFS_I(struct inode *inode)
+{
+    return container_of(inode, struct osfs_inode_info, vfs_inode);
+}
+
+/**
+ * Function: osfs_block_addr
+ * Description: Returns the address of a data block. Shared blocks of an
+ *              overlay are the base's blocks of the same number; private
+ *              blocks are numbered from shared_blocks.
+ */
+static inline void *osfs_block_addr(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    struct osfs_chunk *chunk;
+
+    if (unlikely(block < sb_info->shared_blocks))
+        sb_info = sb_info->base;
+    else
+        block -= sb_info->shared_blocks;
+    chunk = sb_info->chunks[block >> OSFS_CHUNK_SHIFT];
+    return chunk->data + ((size_t)(block & OSFS_CHUNK_MASK) << BLOCK_SIZE_BITS);
+}
+
+/**
+ * Function: osfs_fat
+ * Description: Returns the FAT entry of a block. An overlay keeps its own
+ *              copy of the entries of shared blocks, since unsharing a block
+ *              relinks the chain through them.
+ */
+static inline uint32_t *osfs_fat(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    if (unlikely(block < sb_info->shared_blocks))
+        return &sb_info->fat[block];
+    block -= sb_info->shared_blocks;
+    return sb_info->chunks[block >> OSFS_CHUNK_SHIFT]->fat + (block & OSFS_CHUNK_MASK);
+}
+
+/**
+ * Function: osfs_block_shared
+ * Description: Whether a block belongs to the read-only base of an overlay
+ *              and must be copied before it is written.
+ */
+static inline bool osfs_block_shared(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    return block < sb_info->shared_blocks;
+}
+
+/**
+ * Function: osfs_block_chunk
+ * Description: Returns the chunk of a private block.
+ */
+static inline struct osfs_chunk *osfs_block_chunk(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    return sb_info->chunks[(block - sb_info->shared_blocks) >> OSFS_CHUNK_SHIFT];
+}
+
+/**
+ * Function: osfs_copy_to_iter
+ * Description: Copies file data to a read's destination, or zeroes it for
+ *              a hole if addr is NULL. Under IOCB_NOWAIT page faults are
+ *              disabled, so a destination page that is not resident (never
+ *              touched, or swapped out) ends the copy early instead of
+ *              sleeping.
+ * Returns:
+ *   - The number of bytes copied.
+ */
+static inline size_t osfs_copy_to_iter(struct kiocb *iocb, const void *addr, size_t n, struct iov_iter *to)
+{
+    size_t copied;
+
+    if (!(iocb->ki_flags & IOCB_NOWAIT))
+        return addr ? copy_to_iter(addr, n, to) : iov_iter_zero(n, to);
+    pagefault_disable();
+    copied = addr ? copy_to_iter(addr, n, to) : iov_iter_zero(n, to);
+    pagefault_enable();
+    return copied;
+}
+
+// The error of a read that copied nothing: retry blocking, or a bad buffer
+static inline ssize_t osfs_copy_fault(struct kiocb *iocb)
+{
+    return (iocb->ki_flags & IOCB_NOWAIT) ? -EAGAIN : -EFAULT;
+}
+
+// osfs_file_block() flags
+#define OSFS_FB_CREATE 0x1      // Allocate blocks past the end of the chain
+#define OSFS_FB_WRITE  0x2      // The block will be written: unshare it
+
+/**
+ * Function: osfs_vfs_blocks
+ * Description: Converts an osfs block count to the 512-byte units of
+ *              inode->i_blocks.
+ */
+static inline blkcnt_t osfs_vfs_blocks(uint32_t blocks)
+{
+    return (blkcnt_t)blocks << (BLOCK_SIZE_BITS - 9);
+}
+
 struct inode *osfs_iget(struct super_block *sb, unsigned long ino);
 struct osfs_inode *osfs_get_osfs_inode(struct super_block *sb, uint32_t ino);
-int osfs_get_free_inode(struct osfs_sb_info *sb_info);
+int osfs_get_free_inode(struct osfs_sb_info *sb_info, uint32_t goal);
+void osfs_put_free_inode(struct osfs_sb_info *sb_info, uint32_t ino);
 int osfs_alloc_data_block(struct osfs_sb_info *sb_info, uint32_t *block_no);
+int osfs_alloc_data_block_near(struct osfs_sb_info *sb_info, uint32_t goal, uint32_t *block_no);
 int osfs_fill_super(struct super_block *sb, void *data, int silent);
 struct inode *osfs_new_inode(const struct inode *dir, umode_t mode);
 void osfs_free_data_block(struct osfs_sb_info *sb_info, uint32_t block_no);
-void osfs_destroy_inode(struct inode *inode);
+void osfs_evict_inode(struct inode *inode);
+int osfs_setattr(struct mnt_idmap *idmap, struct dentry *dentry, struct iattr *attr);
+struct inode *osfs_alloc_inode(struct super_block *sb);
+void osfs_free_inode(struct inode *inode);
+int osfs_inode_cache_init(void);
+void osfs_inode_cache_exit(void);
+int osfs_file_block(struct inode *inode, uint64_t index, int flags, uint32_t *block_no);
+int osfs_truncate(struct inode *inode, loff_t size);
+int osfs_write_inode(struct inode *inode, struct writeback_control *wbc);
+long osfs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+void osfs_flush_inodes(struct super_block *sb);
+bool osfs_flush_job(struct osfs_sb_info *sb_info, struct osfs_job *job);
+
+// Directory index (dirindex.c)
+int osfs_dindex_init(struct osfs_sb_info *sb_info);
+void osfs_dindex_destroy(struct osfs_sb_info *sb_info);
+uint32_t osfs_dindex_lookup(struct osfs_sb_info *sb_info, uint32_t dir, const char *name, size_t len);
+struct osfs_dindex_entry *osfs_dindex_find(struct osfs_sb_info *sb_info, uint32_t dir,
+                                           const char *name, size_t len);
+struct osfs_dindex_entry *osfs_dindex_insert(struct osfs_sb_info *sb_info, uint32_t dir,
+                                             const char *name, size_t len, uint32_t ino);
+void osfs_dindex_set_slot(struct osfs_dindex_entry *e, uint16_t slot);
+void osfs_dindex_set_ino(struct osfs_dindex_entry *e, uint32_t ino);
+void osfs_dindex_remove(struct osfs_sb_info *sb_info, struct osfs_dindex_entry *e);
+
+// Named instances and base/overlay sharing (overlay.c)
+int osfs_register_instance(struct osfs_sb_info *sb_info, const char *name);
+void osfs_unregister_instance(struct osfs_sb_info *sb_info);
+struct osfs_sb_info *osfs_get_base(const char *name);
+void osfs_put_base(struct osfs_sb_info *base);
+void osfs_put_sb_info(struct osfs_sb_info *sb_info);
+int osfs_instance_remount(struct osfs_sb_info *sb_info, bool rdonly);
+int osfs_overlay_load(struct osfs_sb_info *sb_info);
+
+// Layout views for user-space analyzers (view.c)
+void osfs_view_init(struct dentry *root);
+void osfs_view_fill_header(struct osfs_sb_info *sb_info);
+void osfs_view_register(struct osfs_sb_info *sb_info);
+void osfs_view_unregister(struct osfs_sb_info *sb_info);
+
+/**
+ * Function: osfs_view_begin
+ * Description: Brackets a change of the block bitmap, inode bitmap or FAT
+ *              with osfs_view_end(), so readers of the views can detect it.
+ *              Unless a view is open the change is only an RCU read-side
+ *              section, which osfs_view_open() waits out before returning.
+ *              The bracket must not sleep.
+ * Returns:
+ *   - Whether the change is counted, to be passed to osfs_view_end().
+ */
+static inline bool osfs_view_begin(struct osfs_sb_info *sb_info)
+{
+    rcu_read_lock();
+    if (likely(!atomic_read(&sb_info->view_users)))
+        return false;
+    rcu_read_unlock();
+    // The u64 counters in the shared page have atomic64_t's layout
+    atomic64_inc((atomic64_t *)&sb_info->view->seq_begin);
+    smp_mb__after_atomic();
+    return true;
+}
+
+static inline void osfs_view_end(struct osfs_sb_info *sb_info, bool counted)
+{
+    if (likely(!counted)) {
+        rcu_read_unlock();
+        return;
+    }
+    smp_mb__before_atomic();
+    atomic64_inc((atomic64_t *)&sb_info->view->seq_end);
+}
+
+// Block pool shared by all mounts (pool.c)
+int osfs_pool_reserve(struct osfs_sb_info *sb_info, uint32_t blocks);
+int osfs_pool_grow(struct osfs_sb_info *sb_info, uint32_t seen);
+void osfs_pool_queue_release(struct osfs_sb_info *sb_info);
+uint64_t osfs_pool_avail(struct osfs_sb_info *sb_info);
+void osfs_pool_init(struct dentry *root);
+void osfs_pool_exit(void);
+
+// Lock and allocator telemetry (stats.c)
+enum osfs_lock_class {
+    OSFS_LOCK_DIR,          // Directory index buckets
+    OSFS_LOCK_INODE,        // inode_lock taken by osfs file I/O
+    OSFS_LOCK_ALLOC,        // Chunk growth of a mount
+    OSFS_LOCK_POOL,         // Block pool and teardown queue
+    OSFS_LOCK_INSTANCE,     // Named instance list
+    OSFS_LOCK_TRACE,        // Op trace ring
+    OSFS_LOCK_JOBS,         // Background job list of a mount
+    OSFS_LOCK_DIRTY,        // Dirty inode list of a mount
+    OSFS_LOCK_NR,
+};
+
+enum osfs_alloc_class {
+    OSFS_ALLOC_BLOCK,
+    OSFS_ALLOC_INODE,
+    OSFS_ALLOC_NR,
+};
+
+struct osfs_lock_stat {
+    u64 acquired;
+    u64 contended;          // The first trylock failed
+    u64 wait_ns;            // Time spent blocked when contended
+};
+
+struct osfs_alloc_stat {
+    u64 calls;
+    u64 failed;
+    u64 scanned;            // Bitmap bits passed over
+    u64 retries;            // Candidate bits lost to a racing allocator
+    u64 time_ns;
+};
+
+struct osfs_stats {
+    struct osfs_lock_stat lock[OSFS_LOCK_NR];
+    struct osfs_alloc_stat alloc[OSFS_ALLOC_NR];
+};
+
+DECLARE_PER_CPU(struct osfs_stats, osfs_stats);
+void osfs_stats_init(struct dentry *root);
+
+static inline void osfs_lock_contended(enum osfs_lock_class cls, u64 start)
+{
+    this_cpu_inc(osfs_stats.lock[cls].contended);
+    this_cpu_add(osfs_stats.lock[cls].wait_ns, local_clock() - start);
+}
+
+static inline void osfs_alloc_stat(enum osfs_alloc_class cls, u64 start, bool failed)
+{
+    this_cpu_inc(osfs_stats.alloc[cls].calls);
+    if (failed)
+        this_cpu_inc(osfs_stats.alloc[cls].failed);
+    this_cpu_add(osfs_stats.alloc[cls].time_ns, local_clock() - start);
+}
+
+/*
+ * Lock wrappers: try the lock first, and only read the clock when that
+ * fails, so an uncontended acquisition costs one per-CPU increment.
+ */
+#define OSFS_LOCK_STAT(cls, trylock_expr, lock_expr)        \
+    do {                                                    \
+        u64 __start;                                        \
+                                                            \
+        this_cpu_inc(osfs_stats.lock[cls].acquired);        \
+        if (!(trylock_expr)) {                              \
+            __start = local_clock();                        \
+            lock_expr;                                      \
+            osfs_lock_contended(cls, __start);              \
+        }                                                   \
+    } while (0)
+
+static inline void osfs_mutex_lock(struct mutex *lock, enum osfs_lock_class cls)
+{
+    OSFS_LOCK_STAT(cls, mutex_trylock(lock), mutex_lock(lock));
+}
+
+static inline void osfs_spin_lock(spinlock_t *lock, enum osfs_lock_class cls)
+{
+    OSFS_LOCK_STAT(cls, spin_trylock(lock), spin_lock(lock));
+}
+
+static inline void osfs_bl_lock(struct hlist_bl_head *b)
+{
+    OSFS_LOCK_STAT(OSFS_LOCK_DIR, bit_spin_trylock(0, (unsigned long *)b), hlist_bl_lock(b));
+}
+
+static inline void osfs_inode_lock(struct inode *inode)
+{
+    OSFS_LOCK_STAT(OSFS_LOCK_INODE, inode_trylock(inode), inode_lock(inode));
+}
+
+static inline void osfs_inode_lock_shared(struct inode *inode)
+{
+    OSFS_LOCK_STAT(OSFS_LOCK_INODE, inode_trylock_shared(inode), inode_lock_shared(inode));
+}
+
+// IOCB_NOWAIT: a failed trylock counts as contended, with no wait
+static inline bool osfs_inode_trylock_shared(struct inode *inode)
+{
+    if (!inode_trylock_shared(inode)) {
+        this_cpu_inc(osfs_stats.lock[OSFS_LOCK_INODE].contended);
+        return false;
+    }
+    this_cpu_inc(osfs_stats.lock[OSFS_LOCK_INODE].acquired);
+    return true;
+}
+
+// Background jobs (jobs.c)
+void osfs_jobs_init(struct osfs_sb_info *sb_info);
+void osfs_jobs_register(struct osfs_sb_info *sb_info);
+void osfs_job_add(struct osfs_sb_info *sb_info, struct osfs_job *job);
+void osfs_job_kick(struct osfs_sb_info *sb_info, struct osfs_job *job);
+bool osfs_job_should_yield(struct osfs_sb_info *sb_info, struct osfs_job *job);
+void osfs_jobs_stop(struct osfs_sb_info *sb_info);
+void osfs_jobs_resume(struct osfs_sb_info *sb_info);
+int osfs_jobs_module_init(void);
+void osfs_jobs_module_exit(void);
+
+/**
+ * Function: osfs_fg_touch
+ * Description: Notes foreground I/O on a mount for idle detection. Only
+ *              writes the shared field once per jiffy.
+ */
+static inline void osfs_fg_touch(struct osfs_sb_info *sb_info)
+{
+    unsigned long now = jiffies;
+
+    if (READ_ONCE(sb_info->fg_last) != now)
+        WRITE_ONCE(sb_info->fg_last, now);
+}
+
+// Log-structured allocation (log.c)
+void osfs_log_init(struct osfs_sb_info *sb_info);
+void osfs_log_register(struct osfs_sb_info *sb_info);
+int osfs_log_alloc(struct osfs_sb_info *sb_info, uint32_t *block_no);
+
+// Orlov-style placement of directories, files and inode numbers (place.c)
+uint32_t osfs_place_inode(struct osfs_sb_info *sb_info, const struct inode *dir, umode_t mode,
+                          uint32_t *block_goal);
+uint32_t osfs_place_file(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode);
+void osfs_place_dir_added(struct osfs_sb_info *sb_info, uint32_t block);
+void osfs_place_dir_removed(struct osfs_sb_info *sb_info, uint32_t block);
+
+// Sealed (immutable) files (seal.c)
+struct fileattr;
+int osfs_seal_inode(struct inode *inode, bool seal);
+void osfs_seal_evict(struct inode *inode);
+ssize_t osfs_read_sealed(struct kiocb *iocb, struct iov_iter *to);
+int osfs_fileattr_get(struct dentry *dentry, struct fileattr *fa);
+int osfs_fileattr_set(struct mnt_idmap *idmap, struct dentry *dentry, struct fileattr *fa);
+int osfs_file_mmap(struct file *file, struct vm_area_struct *vma);
+extern const struct address_space_operations osfs_aops;
+
+// Extended attributes (xattr.c)
+extern const struct xattr_handler * const osfs_xattr_handlers[];
+ssize_t osfs_listxattr(struct dentry *dentry, char *buffer, size_t size);
+
+// Op tracing (trace.c)
+DECLARE_STATIC_KEY_FALSE(osfs_trace_key);
+void __osfs_trace(struct super_block *sb, u16 op, struct inode *inode, struct inode *dir,
+                  const struct qstr *name, u64 offset, u32 len, int ret);
+void __osfs_trace_rename(struct inode *old_dir, struct dentry *old_dentry, struct inode *new_dir,
+                         struct dentry *new_dentry, unsigned int flags, int ret);
+void osfs_trace_init(struct dentry *root);
+void osfs_trace_exit(void);
+
+/**
+ * Function: osfs_trace
+ * Description: Records an op in the trace ring; a nop unless capture is on.
+ */
+static inline void osfs_trace(struct super_block *sb, u16 op, struct inode *inode, struct inode *dir,
+                              const struct qstr *name, u64 offset, u32 len, int ret)
+{
+    if (static_branch_unlikely(&osfs_trace_key))
+        __osfs_trace(sb, op, inode, dir, name, offset, len, ret);
+}
+
+/**
+ * Function: osfs_trace_rename
+ * Description: Records a rename, with both names and any replaced inode.
+ */
+static inline void osfs_trace_rename(struct inode *old_dir, struct dentry *old_dentry, struct inode *new_dir,
+                                     struct dentry *new_dentry, unsigned int flags, int ret)
+{
+    if (static_branch_unlikely(&osfs_trace_key))
+        __osfs_trace_rename(old_dir, old_dentry, new_dir, new_dentry, flags, ret);
+}
+
 // External Operations Structures
 
 extern const struct inode_operations osfs_file_inode_operations;
@@ -87,5 +598,6 @@ extern const struct file_operations osfs_file_operations;
 extern const struct inode_operations osfs_dir_inode_operations;
 extern const struct file_operations osfs_dir_operations;
 extern const struct super_operations osfs_super_ops;
+extern const struct export_operations osfs_export_ops;
 
 #endif /* _osfs_H */
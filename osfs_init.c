@@ -1,7 +1,11 @@
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/debugfs.h>
 #include "osfs.h"
 
+// debugfs directory holding the module-wide control and stats files
+static struct dentry *osfs_debugfs_root;
+
 /**
  * Function: osfs_mount
  * Description: Mounts the osfs filesystem.
@@ -53,9 +57,28 @@ static int __init osfs_init(void)
 {
     int ret;
 
+    ret = osfs_inode_cache_init();
+    if (ret)
+        return ret;
+    ret = osfs_jobs_module_init();
+    if (ret) {
+        osfs_inode_cache_exit();
+        return ret;
+    }
+
+    osfs_debugfs_root = debugfs_create_dir("osfs", NULL);
+    osfs_trace_init(osfs_debugfs_root);
+    osfs_pool_init(osfs_debugfs_root);
+    osfs_stats_init(osfs_debugfs_root);
+    osfs_view_init(osfs_debugfs_root);
+
     ret = register_filesystem(&osfs_type);
     if (ret) {
         pr_err("Failed to register filesystem\n");
+        debugfs_remove_recursive(osfs_debugfs_root);
+        osfs_trace_exit();
+        osfs_jobs_module_exit();
+        osfs_inode_cache_exit();
         return ret;
     }
 
@@ -80,6 +103,16 @@ static void __exit osfs_exit(void)
         pr_err("Failed to unregister filesystem\n");
     else
         pr_info("osfs: Successfully unregistered\n");
+
+    debugfs_remove_recursive(osfs_debugfs_root);
+    osfs_trace_exit();
+
+    // Wait for directory index entries still queued for kfree_rcu and
+    // for inodes still queued for osfs_free_inode
+    rcu_barrier();
+    osfs_jobs_module_exit();
+    osfs_inode_cache_exit();
+    osfs_pool_exit();
 }
 
 /**
@@ -115,10 +148,20 @@ static void osfs_kill_superblock(struct super_block *sb)
 
     pr_info("osfs_kill_superblock: Unmounting file system\n");
 
+    // Background jobs walk the inode list; stop them before shutdown
     if (sb_info) {
-        pr_info("osfs_kill_superblock: free blcok \n");
+        osfs_view_unregister(sb_info);
+        osfs_unregister_instance(sb_info);
+        osfs_jobs_stop(sb_info);
+    }
+
+    // Evict dentries and inodes before the structures they point into go away
+    kill_anon_super(sb);
 
-        vfree(sb_info);
+    if (sb_info) {
+        // Memory is released by a background worker, and only once no
+        // overlay shares our data blocks any more
+        osfs_put_sb_info(sb_info);
         sb->s_fs_info = NULL;
     }
 
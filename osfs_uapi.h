@@ -0,0 +1,95 @@
+#ifndef _OSFS_UAPI_H
+#define _OSFS_UAPI_H
+
+/*
+ * Definitions shared between the osfs module and the user-space tools in
+ * tools/. Only fixed-size types, so the layout is identical on both sides.
+ */
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Change counter of a file or directory, the i_version the kernel keeps
+ * for NFS change attributes. It is bumped after every change of data or
+ * attributes that follows a read of the counter, so two equal reads mean
+ * the inode did not change in between. Survives eviction of the inode,
+ * not unmount.
+ */
+#define OSFS_IOC_GETVERSION _IOR('O', 0x40, __u64)
+
+/* Operation codes recorded in struct osfs_trace_rec */
+enum osfs_trace_op {
+    OSFS_TRACE_LOOKUP = 1,
+    OSFS_TRACE_CREATE,
+    OSFS_TRACE_MKDIR,
+    OSFS_TRACE_READ,
+    OSFS_TRACE_WRITE,
+    OSFS_TRACE_RENAME,
+    OSFS_TRACE_LINK,
+    OSFS_TRACE_UNLINK,
+    OSFS_TRACE_RMDIR,
+};
+
+/**
+ * Struct: osfs_trace_rec
+ * Description: One captured filesystem operation, as read from the
+ *              debugfs file osfs/trace. dir and name_hash name the entry a
+ *              namespace op acted on: the new name of a link, the source of
+ *              a rename. A rename keeps its target in offset and len.
+ */
+struct osfs_trace_rec {
+    __u64 ts_ns;        // ktime_get_ns() when the op completed
+    __u64 offset;       // File offset (read/write); rename: see OSFS_TRACE_RENAME_*
+    __u32 len;          // Requested length (read/write); rename: target name hash
+    __u32 ino;          // Inode operated on, or the looked-up/created inode
+    __u32 dir;          // Parent directory inode (namespace ops)
+    __u32 name_hash;    // jhash of the name (namespace ops)
+    __s32 ret;          // Result: bytes transferred or negative errno
+    __u32 dev;          // Superblock device number, tells mounts apart
+    __u16 op;           // enum osfs_trace_op
+    __u16 type;         // File type of ino (S_IFMT >> 12), 0 if unknown
+    __u32 flags;        // RENAME_* flags (rename), otherwise 0
+};
+
+/* The target of a rename, packed into osfs_trace_rec.offset */
+#define OSFS_TRACE_RENAME_DIR(offset) ((__u32)(offset))            // Target directory
+#define OSFS_TRACE_RENAME_INO(offset) ((__u32)((offset) >> 32))    // Replaced inode, 0 if none
+
+/*
+ * Layout views, read-only debugfs files per mount under
+ * osfs/mounts/<major>:<minor>/, all mmap-able:
+ *   header       struct osfs_view_header
+ *   block_bitmap the live block bitmap, one bit per block
+ *   fat          the live FAT: the entries of an overlay's shared blocks,
+ *                then those of each chunk at a stride of fat_stride bytes
+ *   inodes       struct osfs_view_inode per inode number, a snapshot taken
+ *                when the file is opened
+ *
+ * Consistent snapshot of the live views: read seq_end, then seq_begin; if
+ * they differ a change is in flight, retry. Copy, then reread seq_begin;
+ * if it moved, retry. Changes are only counted while a view is open.
+ */
+struct osfs_view_header {
+    __u64 seq_begin;        // Bumped before each bitmap or FAT change
+    __u64 seq_end;          // Bumped after it
+    __u32 magic;
+    __u32 block_size;
+    __u32 block_count;      // Bits in block_bitmap
+    __u32 inode_count;      // Entries in inodes
+    __u32 shared_blocks;    // Overlay: blocks [0, shared_blocks) are the base's
+    __u32 nr_chunks;        // Backed chunks; fat holds their entries
+    __u32 chunk_blocks;
+    __u32 fat_stride;       // Bytes per chunk in fat, a page multiple
+    __u64 fat_chunk_offset; // Offset of chunk 0 in fat
+};
+
+struct osfs_view_inode {
+    __u64 size;
+    __u32 blocks;
+    __u32 first_block;
+    __u16 mode;             // 0 for a free inode number
+    __u16 links;
+    __u32 parent;           // Directory the inode was created in
+};
+
+#endif /* _OSFS_UAPI_H */
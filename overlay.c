@@ -0,0 +1,256 @@
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include "osfs.h"
+
+/*
+ * Base/overlay sharing. A mount given name=NAME registers itself as an
+ * instance. Once it is read-only, other mounts may use it with base=NAME:
+ * the overlay takes private copies of the metadata (bitmaps, FAT, inode
+ * table) and of the directory and xattr blocks. Regular file data stays in
+ * the base and is shared by every overlay, so a large dataset is loaded
+ * once per host.
+ *
+ * The overlay's block numbers [0, shared_blocks) name the base's backed
+ * blocks, and its private blocks follow. Shared blocks are marked used in the
+ * overlay's bitmap and are never freed. A write to one is first copied
+ * into a private block by osfs_file_block() (copy-on-write at block
+ * granularity).
+ *
+ * The base stays read-only while overlays exist, and its region is
+ * reference counted so that it outlives its own unmount.
+ */
+
+static LIST_HEAD(osfs_instances);
+static DEFINE_MUTEX(osfs_instances_lock);
+
+/**
+ * Function: osfs_register_instance
+ * Description: Publishes a mount under a name so overlays can find it.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - name: The instance name, or NULL for an anonymous mount.
+ * Returns:
+ *   - 0 on success.
+ *   - -EEXIST if another mount already uses the name.
+ */
+int osfs_register_instance(struct osfs_sb_info *sb_info, const char *name)
+{
+    struct osfs_sb_info *i;
+
+    if (!name)
+        return 0;
+
+    osfs_mutex_lock(&osfs_instances_lock, OSFS_LOCK_INSTANCE);
+    list_for_each_entry(i, &osfs_instances, instance) {
+        if (!strcmp(i->name, name)) {
+            mutex_unlock(&osfs_instances_lock);
+            pr_err("osfs: Instance name '%s' is already in use\n", name);
+            return -EEXIST;
+        }
+    }
+    strscpy(sb_info->name, name, sizeof(sb_info->name));
+    list_add_tail(&sb_info->instance, &osfs_instances);
+    mutex_unlock(&osfs_instances_lock);
+    return 0;
+}
+
+/**
+ * Function: osfs_unregister_instance
+ * Description: Removes a mount from the instance list at unmount. Overlays
+ *              already attached keep their reference.
+ */
+void osfs_unregister_instance(struct osfs_sb_info *sb_info)
+{
+    osfs_mutex_lock(&osfs_instances_lock, OSFS_LOCK_INSTANCE);
+    list_del_init(&sb_info->instance);
+    mutex_unlock(&osfs_instances_lock);
+}
+
+/**
+ * Function: osfs_get_base
+ * Description: Looks up a named instance for use as the base of a new
+ *              overlay and pins it.
+ * Inputs:
+ *   - name: The base instance name.
+ * Returns:
+ *   - The base sb_info on success, to be released with osfs_put_base().
+ *   - ERR_PTR(-ENOENT) if no instance has that name.
+ *   - ERR_PTR(-EBUSY) if the instance is not mounted read-only.
+ *   - ERR_PTR(-EINVAL) if the instance is itself an overlay.
+ */
+struct osfs_sb_info *osfs_get_base(const char *name)
+{
+    struct osfs_sb_info *i, *base = ERR_PTR(-ENOENT);
+
+    osfs_mutex_lock(&osfs_instances_lock, OSFS_LOCK_INSTANCE);
+    list_for_each_entry(i, &osfs_instances, instance) {
+        if (strcmp(i->name, name))
+            continue;
+        if (i->base) {
+            pr_err("osfs: Base '%s' is an overlay, stacking is not supported\n", name);
+            base = ERR_PTR(-EINVAL);
+        } else if (!sb_rdonly(i->sb) || i->writable) {
+            pr_err("osfs: Base '%s' must be mounted read-only\n", name);
+            base = ERR_PTR(-EBUSY);
+        } else {
+            refcount_inc(&i->refs);
+            atomic_inc(&i->nr_overlays);
+            base = i;
+        }
+        break;
+    }
+    mutex_unlock(&osfs_instances_lock);
+
+    if (PTR_ERR(base) == -ENOENT)
+        pr_err("osfs: No instance named '%s'\n", name);
+    return base;
+}
+
+/**
+ * Function: osfs_put_base
+ * Description: Drops an overlay's pin on its base.
+ */
+void osfs_put_base(struct osfs_sb_info *base)
+{
+    atomic_dec(&base->nr_overlays);
+    osfs_put_sb_info(base);
+}
+
+/**
+ * Function: osfs_put_sb_info
+ * Description: Drops a reference to a mount's region; the last one queues
+ *              it for the teardown worker, which also drops the reference
+ *              on the base. Overlays hold a reference on their base, so a
+ *              base unmounted before its overlays stays readable.
+ */
+void osfs_put_sb_info(struct osfs_sb_info *sb_info)
+{
+    if (refcount_dec_and_test(&sb_info->refs))
+        osfs_pool_queue_release(sb_info);
+}
+
+/**
+ * Function: osfs_instance_remount
+ * Description: Keeps a base read-only while overlays share it.
+ * Inputs:
+ *   - sb_info: The mount being remounted.
+ *   - rdonly: Whether the remount is read-only.
+ * Returns:
+ *   - 0 on success.
+ *   - -EBUSY if a read-write remount is refused because of overlays.
+ */
+int osfs_instance_remount(struct osfs_sb_info *sb_info, bool rdonly)
+{
+    int ret = 0;
+
+    osfs_mutex_lock(&osfs_instances_lock, OSFS_LOCK_INSTANCE);
+    if (rdonly)
+        sb_info->writable = false;
+    else if (atomic_read(&sb_info->nr_overlays))
+        ret = -EBUSY;
+    else
+        sb_info->writable = true;   // osfs_get_base() refuses from here on
+    mutex_unlock(&osfs_instances_lock);
+    return ret;
+}
+
+/**
+ * Function: osfs_overlay_copy_block
+ * Description: Replaces a block pointer with a private copy of the block.
+ */
+static int osfs_overlay_copy_block(struct osfs_sb_info *sb_info, uint32_t *block)
+{
+    uint32_t new_block;
+    int ret;
+
+    ret = osfs_alloc_data_block(sb_info, &new_block);
+    if (ret)
+        return ret;
+    memcpy(osfs_block_addr(sb_info, new_block), osfs_block_addr(sb_info, *block), BLOCK_SIZE);
+    *block = new_block;
+    return 0;
+}
+
+/**
+ * Function: osfs_overlay_index
+ * Description: Fills the directory index of an overlay from the directory
+ *              blocks copied from the base.
+ */
+static int osfs_overlay_index(struct osfs_sb_info *sb_info)
+{
+    struct osfs_inode *table = sb_info->inode_table;
+    struct osfs_dindex_entry *e;
+    struct osfs_dir_entry *entries;
+    uint32_t ino, slot, nr;
+
+    for_each_set_bit(ino, sb_info->inode_bitmap, sb_info->inode_count) {
+        if (!S_ISDIR(table[ino].i_mode))
+            continue;
+        entries = osfs_block_addr(sb_info, table[ino].i_block);
+        nr = min_t(uint64_t, table[ino].i_size / sizeof(struct osfs_dir_entry), MAX_DIR_ENTRIES);
+        for (slot = 0; slot < nr; slot++) {
+            if (!entries[slot].inode_no)
+                continue;
+            e = osfs_dindex_insert(sb_info, ino, entries[slot].filename,
+                                   strnlen(entries[slot].filename, MAX_FILENAME_LEN), entries[slot].inode_no);
+            if (IS_ERR(e))
+                return PTR_ERR(e);
+            osfs_dindex_set_slot(e, slot);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_overlay_load
+ * Description: Initializes a new overlay from its base: copies the
+ *              metadata, unshares directory and xattr blocks, reserves the
+ *              shared block range and builds the directory index. The base
+ *              is read-only, so it is copied without locking.
+ * Inputs:
+ *   - sb_info: The overlay, with base and shared_blocks set.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if the overlay's private blocks cannot hold the base's
+ *     directories and xattr blocks.
+ *   - -ENOMEM if the directory index cannot be filled.
+ */
+int osfs_overlay_load(struct osfs_sb_info *sb_info)
+{
+    struct osfs_sb_info *base = sb_info->base;
+    struct osfs_inode *table = sb_info->inode_table;
+    uint32_t ino, c;
+    int ret = 0;
+
+    bitmap_copy(sb_info->inode_bitmap, base->inode_bitmap, base->inode_count);
+    bitmap_set(sb_info->block_bitmap, 0, sb_info->shared_blocks);
+    for (c = 0; (uint64_t)c << OSFS_CHUNK_SHIFT < sb_info->shared_blocks; c++)
+        memcpy(sb_info->fat + ((size_t)c << OSFS_CHUNK_SHIFT), base->chunks[c]->fat,
+               min_t(size_t, OSFS_CHUNK_BLOCKS, sb_info->shared_blocks - ((size_t)c << OSFS_CHUNK_SHIFT)) *
+               sizeof(uint32_t));
+    memcpy(table, base->inode_table, (size_t)base->inode_count * sizeof(struct osfs_inode));
+
+    atomic_set(&sb_info->nr_free_inodes,
+               sb_info->inode_count - 1 - bitmap_weight(sb_info->inode_bitmap, sb_info->inode_count));
+    atomic_set(&sb_info->nr_free_blocks, sb_info->block_count - sb_info->shared_blocks);
+    atomic_set(&sb_info->next_generation, atomic_read(&base->next_generation));
+    sb_info->block_hint = sb_info->shared_blocks;
+
+    for_each_set_bit(ino, sb_info->inode_bitmap, sb_info->inode_count) {
+        if (S_ISDIR(table[ino].i_mode)) {
+            ret = osfs_overlay_copy_block(sb_info, &table[ino].i_block);
+            if (!ret)
+                osfs_place_dir_added(sb_info, table[ino].i_block);
+        }
+        if (!ret && table[ino].i_xattr_block != OSFS_NO_BLOCK)
+            ret = osfs_overlay_copy_block(sb_info, &table[ino].i_xattr_block);
+        if (ret) {
+            pr_err("osfs: blocks= is too small for the metadata of base '%s'\n", base->name);
+            return ret;
+        }
+    }
+
+    pr_info("osfs: Overlay of '%s' sharing %u blocks\n", base->name, sb_info->shared_blocks);
+    return osfs_overlay_index(sb_info);
+}
@@ -0,0 +1,169 @@
+#include <linux/random.h>
+#include "osfs.h"
+
+/*
+ * Placement policy, after the Orlov allocator of ext2/3/4. The private
+ * block range is divided into regions, one per chunk; the inode numbers
+ * are divided into as many groups, group r being the numbers of region r.
+ *
+ *   - A top-level directory goes to a region with at least the average
+ *     free blocks and at most the average directories, searched from a
+ *     random start, so unrelated trees spread out.
+ *   - A subdirectory stays in its parent's region while that has room,
+ *     and is spread the same way otherwise.
+ *   - A file's first block is searched from its parent directory's block,
+ *     and every later block from the block before it, so a tree is laid
+ *     out close to where it is walked.
+ *   - A directory's inode number starts its region's group; a file's is
+ *     the next free number after its parent's.
+ *
+ * Only backed chunks are candidates: spreading into unbacked regions would
+ * back memory a mount does not need yet. A mount that fits one chunk
+ * therefore places everything in it, where locality comes for free.
+ * alloc=log mounts ignore block goals, the log head decides.
+ */
+
+#define OSFS_PLACE_MIN_FREE(size) ((size) / 8)  // Room a parent's region must keep
+
+static inline uint32_t osfs_region_size(struct osfs_sb_info *sb_info, uint32_t r)
+{
+    return min(OSFS_CHUNK_BLOCKS, sb_info->block_count - sb_info->shared_blocks - (r << OSFS_CHUNK_SHIFT));
+}
+
+static inline uint32_t osfs_region_free(struct osfs_sb_info *sb_info, uint32_t r)
+{
+    return osfs_region_size(sb_info, r) - atomic_read(&sb_info->chunks[r]->live);
+}
+
+/**
+ * Function: osfs_region_of
+ * Description: The region of a block, or U32_MAX for a block of an
+ *              overlay's base.
+ */
+static inline uint32_t osfs_region_of(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    if (block == OSFS_NO_BLOCK || osfs_block_shared(sb_info, block))
+        return U32_MAX;
+    return (block - sb_info->shared_blocks) >> OSFS_CHUNK_SHIFT;
+}
+
+static inline uint32_t osfs_region_start(struct osfs_sb_info *sb_info, uint32_t r)
+{
+    return sb_info->shared_blocks + (r << OSFS_CHUNK_SHIFT);
+}
+
+/**
+ * Function: osfs_place_dir
+ * Description: Chooses the region of a new directory.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - parent: The parent directory's osfs_inode.
+ *   - parent_ino: Its inode number.
+ * Returns:
+ *   - The region, below the backed chunk count, or U32_MAX if none is
+ *     backed yet.
+ */
+static uint32_t osfs_place_dir(struct osfs_sb_info *sb_info, struct osfs_inode *parent, uint32_t parent_ino)
+{
+    uint32_t nr = smp_load_acquire(&sb_info->nr_chunks);
+    uint32_t parent_r = osfs_region_of(sb_info, READ_ONCE(parent->i_block));
+    uint64_t total_free = 0, total_dirs = 0;
+    uint32_t r, i, start, free, dirs, best = U32_MAX, best_free = 0;
+
+    if (!nr)
+        return U32_MAX;
+    if (nr == 1)
+        return 0;
+
+    for (r = 0; r < nr; r++) {
+        total_free += osfs_region_free(sb_info, r);
+        total_dirs += atomic_read(&sb_info->chunks[r]->dirs);
+    }
+
+    // Subdirectories stay with their parent while its region has room
+    if (parent_ino != ROOT_INODE && parent_r < nr &&
+        osfs_region_free(sb_info, parent_r) > OSFS_PLACE_MIN_FREE(osfs_region_size(sb_info, parent_r)))
+        return parent_r;
+
+    start = parent_ino == ROOT_INODE || parent_r >= nr ? get_random_u32_below(nr) : parent_r;
+    for (i = 0; i < nr; i++) {
+        r = (start + i) % nr;
+        free = osfs_region_free(sb_info, r);
+        dirs = atomic_read(&sb_info->chunks[r]->dirs);
+        if ((uint64_t)free * nr >= total_free && (uint64_t)dirs * nr <= total_dirs)
+            return r;
+        if (free > best_free) {
+            best = r;
+            best_free = free;
+        }
+    }
+    return best != U32_MAX ? best : start;
+}
+
+/**
+ * Function: osfs_place_inode
+ * Description: Chooses where a new inode goes: the goal for its inode
+ *              number and, for a directory, for its block.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - dir: The parent directory.
+ *   - mode: The new inode's mode.
+ *   - block_goal: Set to the block search start of a directory.
+ * Returns:
+ *   - The inode number to start the search at.
+ */
+uint32_t osfs_place_inode(struct osfs_sb_info *sb_info, const struct inode *dir, umode_t mode,
+                          uint32_t *block_goal)
+{
+    struct osfs_inode *parent = dir->i_private;
+    uint32_t max_regions = DIV_ROUND_UP(sb_info->block_count - sb_info->shared_blocks, OSFS_CHUNK_BLOCKS);
+    uint32_t r;
+
+    *block_goal = READ_ONCE(sb_info->block_hint);
+    if (!S_ISDIR(mode))
+        return dir->i_ino + 1;
+
+    r = osfs_place_dir(sb_info, parent, dir->i_ino);
+    if (r == U32_MAX)
+        return dir->i_ino + 1;
+    *block_goal = osfs_region_start(sb_info, r);
+    return max_t(uint32_t, div_u64((uint64_t)r * sb_info->inode_count, max_regions), ROOT_INODE + 1);
+}
+
+/**
+ * Function: osfs_place_file
+ * Description: The block search start for the first block of a file: the
+ *              block of the directory it was created in.
+ */
+uint32_t osfs_place_file(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    struct osfs_inode *parent = osfs_get_osfs_inode(sb_info->sb, osfs_inode->i_parent);
+
+    if (parent && S_ISDIR(READ_ONCE(parent->i_mode)) && READ_ONCE(parent->i_blocks))
+        return READ_ONCE(parent->i_block);
+    return READ_ONCE(sb_info->block_hint);
+}
+
+/**
+ * Function: osfs_place_dir_added
+ * Description: Counts a directory in the region of its block.
+ */
+void osfs_place_dir_added(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    uint32_t r = osfs_region_of(sb_info, block);
+
+    if (r != U32_MAX)
+        atomic_inc(&sb_info->chunks[r]->dirs);
+}
+
+/**
+ * Function: osfs_place_dir_removed
+ * Description: Uncounts a directory whose block is being freed.
+ */
+void osfs_place_dir_removed(struct osfs_sb_info *sb_info, uint32_t block)
+{
+    uint32_t r = osfs_region_of(sb_info, block);
+
+    if (r != U32_MAX)
+        atomic_dec(&sb_info->chunks[r]->dirs);
+}
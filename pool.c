@@ -0,0 +1,356 @@
+#include <linux/debugfs.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include "osfs.h"
+
+static unsigned long pool_mb;
+module_param(pool_mb, ulong, 0444);
+MODULE_PARM_DESC(pool_mb, "Capacity of the block pool shared by all mounts in MiB (0: half of RAM)");
+
+static unsigned int pool_cache_chunks = 16;
+module_param(pool_cache_chunks, uint, 0644);
+MODULE_PARM_DESC(pool_cache_chunks, "Released chunks kept for reuse by later mounts");
+
+/*
+ * Block pool shared by all mounts. Data blocks come in chunks of
+ * OSFS_CHUNK_BLOCKS, handed to a mount when its allocator runs out of
+ * backed blocks, so a mount only holds memory for what it has used rather
+ * than for its whole blocks= limit. A mount keeps its chunks until unmount.
+ *
+ * A mount may reserve chunks up front (reserve=), which nothing else can
+ * take. committed counts, over all mounts, the larger of the chunks held
+ * and the chunks reserved; a chunk beyond a mount's reservation is only
+ * granted while committed stays within the capacity.
+ */
+static struct {
+    spinlock_t lock;
+    unsigned long capacity;     // Chunks
+    unsigned long committed;    // Held or reserved chunks, see above
+    unsigned long in_use;       // Chunks held by mounts
+    unsigned long nr_cached;
+    struct list_head cache;     // Released chunks kept for reuse
+} osfs_pool = {
+    .lock = __SPIN_LOCK_UNLOCKED(osfs_pool.lock),
+    .cache = LIST_HEAD_INIT(osfs_pool.cache),
+};
+
+static void osfs_chunk_free(struct osfs_chunk *chunk)
+{
+    vfree(chunk->data);
+    vfree(chunk->fat);
+    kfree(chunk);
+}
+
+/**
+ * Function: osfs_chunk_alloc
+ * Description: Allocates a chunk. The data area is a huge vmalloc mapping
+ *              where possible, which keeps TLB pressure low on large mounts.
+ *              The FAT entries get pages of their own so the fat view can
+ *              map them. Blocks are zeroed when allocated, not here.
+ */
+static struct osfs_chunk *osfs_chunk_alloc(void)
+{
+    struct osfs_chunk *chunk = kmalloc(sizeof(*chunk), GFP_KERNEL);
+
+    if (!chunk)
+        return NULL;
+    chunk->data = vmalloc_huge((size_t)OSFS_CHUNK_BLOCKS << BLOCK_SIZE_BITS, GFP_KERNEL);
+    chunk->fat = vzalloc(OSFS_CHUNK_FAT_SIZE);
+    if (!chunk->data || !chunk->fat) {
+        vfree(chunk->data);
+        vfree(chunk->fat);
+        kfree(chunk);
+        return NULL;
+    }
+    return chunk;
+}
+
+/**
+ * Function: osfs_pool_charge
+ * Description: Accounts one more chunk to a mount. Chunks within the
+ *              mount's reservation are already committed.
+ * Returns:
+ *   - true if the chunk may be granted.
+ */
+static bool osfs_pool_charge(struct osfs_sb_info *sb_info)
+{
+    bool ok = true;
+
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    if (sb_info->nr_chunks >= sb_info->reserved_chunks) {
+        if (osfs_pool.committed >= osfs_pool.capacity)
+            ok = false;
+        else
+            osfs_pool.committed++;
+    }
+    if (ok)
+        osfs_pool.in_use++;
+    spin_unlock(&osfs_pool.lock);
+    return ok;
+}
+
+static void osfs_pool_uncharge(struct osfs_sb_info *sb_info)
+{
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    if (sb_info->nr_chunks >= sb_info->reserved_chunks)
+        osfs_pool.committed--;
+    osfs_pool.in_use--;
+    spin_unlock(&osfs_pool.lock);
+}
+
+/**
+ * Function: osfs_pool_reserve
+ * Description: Commits chunks for the reserve= guarantee of a new mount.
+ * Inputs:
+ *   - sb_info: The mount, holding no chunks yet.
+ *   - blocks: The number of blocks to guarantee.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if the pool cannot guarantee that many blocks.
+ */
+int osfs_pool_reserve(struct osfs_sb_info *sb_info, uint32_t blocks)
+{
+    unsigned long chunks = DIV_ROUND_UP(blocks, OSFS_CHUNK_BLOCKS);
+    int ret = 0;
+
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    if (chunks > osfs_pool.capacity - osfs_pool.committed)
+        ret = -ENOSPC;
+    else
+        osfs_pool.committed += chunks;
+    spin_unlock(&osfs_pool.lock);
+
+    if (ret) {
+        pr_err("osfs: Cannot reserve %u blocks, the pool is committed\n", blocks);
+        return ret;
+    }
+    sb_info->reserved_chunks = chunks;
+    return 0;
+}
+
+/**
+ * Function: osfs_pool_grow
+ * Description: Backs the next chunk of a mount's block range with memory
+ *              from the pool. Called by osfs_alloc_data_block() once every
+ *              backed block is in use; chunks are added in order, so the
+ *              backed blocks are always a prefix of the mount's range.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - seen: The chunk count the caller searched; if another allocator grew
+ *     the mount meanwhile, nothing is done and the caller searches again.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOSPC if the mount is at its blocks= limit or the pool is full.
+ *   - -ENOMEM if the chunk cannot be allocated.
+ */
+int osfs_pool_grow(struct osfs_sb_info *sb_info, uint32_t seen)
+{
+    struct osfs_chunk *chunk = NULL;
+    uint32_t nr;
+    int ret = 0;
+
+    osfs_mutex_lock(&sb_info->chunk_lock, OSFS_LOCK_ALLOC);
+    nr = sb_info->nr_chunks;
+    if (nr != seen)
+        goto out;
+    if ((uint64_t)nr * OSFS_CHUNK_BLOCKS >= sb_info->block_count - sb_info->shared_blocks ||
+        !osfs_pool_charge(sb_info)) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    chunk = list_first_entry_or_null(&osfs_pool.cache, struct osfs_chunk, list);
+    if (chunk) {
+        list_del(&chunk->list);
+        osfs_pool.nr_cached--;
+    }
+    spin_unlock(&osfs_pool.lock);
+
+    // A cached chunk still holds its last mount's chains, and the fat
+    // view maps the whole table, not only the allocated entries
+    if (chunk)
+        memset(chunk->fat, 0, OSFS_CHUNK_FAT_SIZE);
+    else
+        chunk = osfs_chunk_alloc();
+    if (!chunk) {
+        osfs_pool_uncharge(sb_info);
+        ret = -ENOMEM;
+        goto out;
+    }
+    atomic_set(&chunk->live, 0);
+    atomic_set(&chunk->dirs, 0);
+    sb_info->chunks[nr] = chunk;
+    // Publishes the chunk pointer to osfs_alloc_data_block()
+    smp_store_release(&sb_info->nr_chunks, nr + 1);
+    WRITE_ONCE(sb_info->view->nr_chunks, nr + 1);
+out:
+    mutex_unlock(&sb_info->chunk_lock);
+    return ret;
+}
+
+/*
+ * Asynchronous teardown. Dropping the last reference to a mount's region
+ * (at unmount, or when the last overlay of a base goes away) only queues
+ * it; a worker frees the directory index and hands the chunks back in
+ * batches, so umount returns without waiting on memory proportional to the
+ * data stored. Progress is shown in the pool debugfs file.
+ */
+#define OSFS_TEARDOWN_BATCH 64  // Chunks released between reschedule points
+
+static LIST_HEAD(osfs_teardown_list);
+static DEFINE_SPINLOCK(osfs_teardown_lock);
+static atomic_t teardown_mounts;        // Regions queued or being freed
+static atomic_long_t teardown_chunks;   // Chunks they still hold
+
+static void osfs_teardown_work_fn(struct work_struct *work);
+static DECLARE_WORK(osfs_teardown_work, osfs_teardown_work_fn);
+
+/**
+ * Function: osfs_pool_release
+ * Description: Returns all chunks and the reservation of a mount to the
+ *              pool, one batch at a time. The capacity becomes available
+ *              again once the memory has actually been released.
+ */
+static void osfs_pool_release(struct osfs_sb_info *sb_info)
+{
+    struct osfs_chunk *chunk;
+    LIST_HEAD(to_free);
+    uint32_t i = 0, n, batch;
+
+    while (i < sb_info->nr_chunks) {
+        batch = min_t(uint32_t, sb_info->nr_chunks - i, OSFS_TEARDOWN_BATCH);
+
+        osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+        for (n = 0; n < batch; n++, i++) {
+            chunk = sb_info->chunks[i];
+            if (osfs_pool.nr_cached < READ_ONCE(pool_cache_chunks)) {
+                list_add(&chunk->list, &osfs_pool.cache);
+                osfs_pool.nr_cached++;
+            } else {
+                list_add(&chunk->list, &to_free);
+            }
+        }
+        spin_unlock(&osfs_pool.lock);
+
+        while ((chunk = list_first_entry_or_null(&to_free, struct osfs_chunk, list))) {
+            list_del(&chunk->list);
+            osfs_chunk_free(chunk);
+        }
+        atomic_long_sub(batch, &teardown_chunks);
+        cond_resched();
+    }
+
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    osfs_pool.committed -= max(sb_info->nr_chunks, sb_info->reserved_chunks);
+    osfs_pool.in_use -= sb_info->nr_chunks;
+    spin_unlock(&osfs_pool.lock);
+    sb_info->nr_chunks = sb_info->reserved_chunks = 0;
+}
+
+static void osfs_teardown_work_fn(struct work_struct *work)
+{
+    struct osfs_sb_info *sb_info, *base;
+
+    for (;;) {
+        osfs_spin_lock(&osfs_teardown_lock, OSFS_LOCK_POOL);
+        sb_info = list_first_entry_or_null(&osfs_teardown_list, struct osfs_sb_info, teardown);
+        if (sb_info)
+            list_del(&sb_info->teardown);
+        spin_unlock(&osfs_teardown_lock);
+        if (!sb_info)
+            return;
+
+        osfs_dindex_destroy(sb_info);
+        osfs_pool_release(sb_info);
+        base = sb_info->base;
+        vfree(sb_info);
+        atomic_dec(&teardown_mounts);
+        // May queue the base in turn, picked up by this loop
+        if (base)
+            osfs_put_base(base);
+    }
+}
+
+/**
+ * Function: osfs_pool_queue_release
+ * Description: Hands an unreferenced region to the teardown worker.
+ */
+void osfs_pool_queue_release(struct osfs_sb_info *sb_info)
+{
+    atomic_inc(&teardown_mounts);
+    atomic_long_add(sb_info->nr_chunks, &teardown_chunks);
+    osfs_spin_lock(&osfs_teardown_lock, OSFS_LOCK_POOL);
+    list_add_tail(&sb_info->teardown, &osfs_teardown_list);
+    spin_unlock(&osfs_teardown_lock);
+    queue_work(system_unbound_wq, &osfs_teardown_work);
+}
+
+/**
+ * Function: osfs_pool_avail
+ * Description: The number of blocks a mount can still allocate: its free
+ *              backed blocks plus what the pool would still grant it.
+ */
+uint64_t osfs_pool_avail(struct osfs_sb_info *sb_info)
+{
+    uint64_t limit = sb_info->block_count - sb_info->shared_blocks;
+    uint64_t used = limit - atomic_read(&sb_info->nr_free_blocks);
+    uint32_t nr_chunks = READ_ONCE(sb_info->nr_chunks);
+    uint64_t backed = min_t(uint64_t, (uint64_t)nr_chunks * OSFS_CHUNK_BLOCKS, limit);
+    unsigned long grant;
+
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    grant = osfs_pool.capacity - osfs_pool.committed;
+    if (sb_info->reserved_chunks > nr_chunks)
+        grant += sb_info->reserved_chunks - nr_chunks;
+    spin_unlock(&osfs_pool.lock);
+
+    return (backed > used ? backed - used : 0) + (uint64_t)grant * OSFS_CHUNK_BLOCKS;
+}
+
+static int osfs_pool_show(struct seq_file *m, void *v)
+{
+    osfs_spin_lock(&osfs_pool.lock, OSFS_LOCK_POOL);
+    seq_printf(m, "chunk_blocks %u\ncapacity %lu\ncommitted %lu\nin_use %lu\ncached %lu\n",
+               OSFS_CHUNK_BLOCKS, osfs_pool.capacity, osfs_pool.committed,
+               osfs_pool.in_use, osfs_pool.nr_cached);
+    spin_unlock(&osfs_pool.lock);
+    seq_printf(m, "teardown_mounts %d\nteardown_chunks %ld\n",
+               atomic_read(&teardown_mounts), atomic_long_read(&teardown_chunks));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(osfs_pool);
+
+/**
+ * Function: osfs_pool_init
+ * Description: Sizes the pool at module load and adds its debugfs file.
+ */
+void osfs_pool_init(struct dentry *root)
+{
+    unsigned long mb = pool_mb;
+
+    if (!mb)
+        mb = (totalram_pages() >> (20 - PAGE_SHIFT)) / 2;
+    osfs_pool.capacity = max(1UL, mb / 2);   // 2 MiB chunks
+    pr_info("osfs: Block pool of %lu MiB\n", osfs_pool.capacity << 1);
+    debugfs_create_file("pool", 0400, root, NULL, &osfs_pool_fops);
+}
+
+/**
+ * Function: osfs_pool_exit
+ * Description: Waits for queued teardowns and frees the cached chunks at
+ *              module unload.
+ */
+void osfs_pool_exit(void)
+{
+    struct osfs_chunk *chunk, *tmp;
+
+    flush_work(&osfs_teardown_work);
+
+    list_for_each_entry_safe(chunk, tmp, &osfs_pool.cache, list)
+        osfs_chunk_free(chunk);
+    INIT_LIST_HEAD(&osfs_pool.cache);
+    osfs_pool.nr_cached = 0;
+}
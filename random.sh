@@ -1,13 +1,14 @@
 #!/bin/bash
 
 # Check if the correct number of arguments is provided
-if [ "$#" -ne 1 ]; then
-    echo "Usage: $0 <byte_size>"
+if [ "$#" -lt 1 ] || [ "$#" -gt 2 ]; then
+    echo "Usage: $0 <byte_size> [seed]"
     exit 1
 fi
 
 # Parameters
 BYTE_SIZE=$1
+SEED=${2:-1}
 
 # Validate that BYTE_SIZE is a positive integer
 if ! [[ "$BYTE_SIZE" =~ ^[0-9]+$ ]] || [ "$BYTE_SIZE" -le 0 ]; then
@@ -15,5 +16,9 @@ if ! [[ "$BYTE_SIZE" =~ ^[0-9]+$ ]] || [ "$BYTE_SIZE" -le 0 ]; then
     exit 1
 fi
 
-# Generate random alphanumeric text
-< /dev/urandom tr -dc 'A-Za-z0-9' | head -c "$BYTE_SIZE"
\ No newline at end of file
+# Generate seeded, verifiable data (check later with: tools/osfs_gen verify -s SEED file)
+GEN="$(dirname "$0")/tools/osfs_gen"
+if [ ! -x "$GEN" ]; then
+    make -s -C "$(dirname "$0")/tools" osfs_gen >&2 || exit 1
+fi
+exec "$GEN" gen -s "$SEED" -n "$BYTE_SIZE"
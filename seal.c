@@ -0,0 +1,355 @@
+#include <linux/fileattr.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/srcu.h>
+#include <linux/uaccess.h>
+#include "osfs.h"
+
+/*
+ * Sealed files. chattr +i (FS_IMMUTABLE_FL) makes the VFS refuse every
+ * change to a file, so its block chain is fixed: it is flattened once into
+ * a map of extents, runs of blocks adjacent in memory, and reads go
+ * through the map with no inode lock, no FAT walk and no cursor. Sealed
+ * files may also be mmapped, read-only, through the page cache, which uses
+ * large folios and so PMD mappings where the file allows.
+ *
+ * Readers only hold osfs_seal_srcu. Unsealing unpublishes the map, waits
+ * for those readers, and drops the page cache; a mapping that faults after
+ * that gets SIGBUS.
+ */
+
+DEFINE_STATIC_SRCU(osfs_seal_srcu);
+
+#define OSFS_FL_USER_VISIBLE    FS_IMMUTABLE_FL
+#define OSFS_FL_USER_MODIFIABLE FS_IMMUTABLE_FL
+
+/**
+ * Struct: osfs_seal_map
+ * Description: The block map of a sealed file.
+ */
+struct osfs_seal_map {
+    uint64_t size;              // File size, fixed while sealed
+    uint32_t nr;
+    struct osfs_extent {
+        uint64_t index;         // First block index of the run
+        uint32_t block;         // Its data block
+        uint32_t count;
+    } ext[];
+};
+
+/**
+ * Function: osfs_seal_build
+ * Description: Flattens the block chain of a file into extents. Blocks are
+ *              merged while they are adjacent in memory, which holds within
+ *              a chunk for consecutive block numbers.
+ * Inputs:
+ *   - inode: The file, whose chain cannot change (inode_lock or I_NEW).
+ * Returns:
+ *   - The map on success.
+ *   - NULL if it cannot be allocated.
+ */
+static struct osfs_seal_map *osfs_seal_build(struct inode *inode)
+{
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_seal_map *map;
+    struct osfs_extent *e = NULL;
+    uint32_t nr_blocks = osfs_inode->i_blocks, block = osfs_inode->i_block, i, nr = 0;
+
+    // Worst case one extent per block; trimmed below
+    map = kvmalloc(struct_size(map, ext, nr_blocks), GFP_KERNEL);
+    if (!map)
+        return NULL;
+    for (i = 0; i < nr_blocks; i++) {
+        if (e && osfs_block_addr(sb_info, e->block) + ((size_t)e->count << BLOCK_SIZE_BITS) ==
+                 osfs_block_addr(sb_info, block)) {
+            e->count++;
+        } else {
+            e = &map->ext[nr++];
+            e->index = i;
+            e->block = block;
+            e->count = 1;
+        }
+        block = *osfs_fat(sb_info, block);
+    }
+    map->nr = nr;
+    map->size = osfs_inode->i_size;
+    if (nr < nr_blocks) {
+        struct osfs_seal_map *small = kvmalloc(struct_size(map, ext, nr), GFP_KERNEL);
+
+        if (small) {
+            memcpy(small, map, struct_size(map, ext, nr));
+            kvfree(map);
+            map = small;
+        }
+    }
+    return map;
+}
+
+/**
+ * Function: osfs_seal_span
+ * Description: Looks up the bytes of a sealed file stored contiguously at a
+ *              position.
+ * Inputs:
+ *   - sb_info: The mount.
+ *   - map: The file's map.
+ *   - pos: The position, below map->size.
+ *   - addr: Set to the data, or NULL for a hole that reads as zeroes.
+ * Returns:
+ *   - The number of bytes available at addr, at least one.
+ */
+static size_t osfs_seal_span(struct osfs_sb_info *sb_info, const struct osfs_seal_map *map,
+                             uint64_t pos, void **addr)
+{
+    uint64_t index = pos >> BLOCK_SIZE_BITS, end;
+    uint32_t lo = 0, hi = map->nr;
+    const struct osfs_extent *e;
+
+    // Last extent starting at or before index
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (map->ext[mid].index <= index)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo || index >= map->ext[lo - 1].index + map->ext[lo - 1].count) {
+        // Past the chain: a hole up to the next extent or the end
+        end = lo < map->nr ? map->ext[lo].index << BLOCK_SIZE_BITS : map->size;
+        *addr = NULL;
+        return min(end, map->size) - pos;
+    }
+    e = &map->ext[lo - 1];
+    end = (e->index + e->count) << BLOCK_SIZE_BITS;
+    *addr = osfs_block_addr(sb_info, e->block) + (pos - (e->index << BLOCK_SIZE_BITS));
+    return min(end, map->size) - pos;
+}
+
+/**
+ * Function: osfs_read_sealed
+ * Description: Lockless read of a sealed file, one copy per extent. Never
+ *              sleeps except on faults of the destination, which
+ *              IOCB_NOWAIT disables.
+ * Inputs:
+ *   - iocb, to: As for osfs_read_iter.
+ * Returns:
+ *   - The number of bytes read.
+ *   - -EFAULT (-EAGAIN with IOCB_NOWAIT) if nothing could be copied.
+ *   - -ENOTBLK if the file is not sealed; the caller takes the normal path.
+ */
+ssize_t osfs_read_sealed(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct inode *inode = file_inode(iocb->ki_filp);
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    const struct osfs_seal_map *map;
+    size_t done = 0, n, copied;
+    loff_t pos = iocb->ki_pos;
+    bool fault = false;
+    void *addr;
+    int idx;
+
+    if (!IS_IMMUTABLE(inode))
+        return -ENOTBLK;
+    idx = srcu_read_lock(&osfs_seal_srcu);
+    map = srcu_dereference(OSFS_I(inode)->i_map, &osfs_seal_srcu);
+    if (!map) {
+        srcu_read_unlock(&osfs_seal_srcu, idx);
+        return -ENOTBLK;
+    }
+    while (iov_iter_count(to) && pos < map->size) {
+        n = min(iov_iter_count(to), osfs_seal_span(sb_info, map, pos, &addr));
+        copied = osfs_copy_to_iter(iocb, addr, n, to);
+        done += copied;
+        pos += copied;
+        if (copied < n) {
+            fault = true;
+            break;
+        }
+    }
+    srcu_read_unlock(&osfs_seal_srcu, idx);
+
+    if (fault && !done)
+        return osfs_copy_fault(iocb);
+    return done;
+}
+
+/**
+ * Function: osfs_seal_inode
+ * Description: Applies the FS_IMMUTABLE_FL state of an osfs_inode to its
+ *              VFS inode, building or dropping the map of a regular file.
+ *              Callers hold inode_lock, or the inode is I_NEW.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENOMEM if the map cannot be built.
+ */
+int osfs_seal_inode(struct inode *inode, bool seal)
+{
+    struct osfs_inode_info *oi = OSFS_I(inode);
+    struct osfs_seal_map *map = NULL, *old;
+
+    if (seal && S_ISREG(inode->i_mode)) {
+        map = osfs_seal_build(inode);
+        if (!map)
+            return -ENOMEM;
+    }
+
+    if (seal) {
+        // The map is published before the flag readers check first
+        rcu_assign_pointer(oi->i_map, map);
+        inode_set_flags(inode, S_IMMUTABLE, S_IMMUTABLE);
+        return 0;
+    }
+
+    inode_set_flags(inode, 0, S_IMMUTABLE);
+    old = rcu_replace_pointer(oi->i_map, NULL, true);
+    if (old) {
+        synchronize_srcu(&osfs_seal_srcu);
+        kvfree(old);
+        // Mappings of the sealed file are revoked: writes bypass the cache
+        invalidate_inode_pages2(inode->i_mapping);
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_seal_evict
+ * Description: Frees the map of an inode being evicted.
+ */
+void osfs_seal_evict(struct inode *inode)
+{
+    kvfree(rcu_dereference_protected(OSFS_I(inode)->i_map, true));
+    RCU_INIT_POINTER(OSFS_I(inode)->i_map, NULL);
+}
+
+int osfs_fileattr_get(struct dentry *dentry, struct fileattr *fa)
+{
+    struct osfs_inode *osfs_inode = d_inode(dentry)->i_private;
+
+    fileattr_fill_flags(fa, osfs_inode->i_flags & OSFS_FL_USER_VISIBLE);
+    return 0;
+}
+
+/**
+ * Function: osfs_fileattr_set
+ * Description: FS_IOC_SETFLAGS/FS_IOC_FSSETXATTR. Only FS_IMMUTABLE_FL is
+ *              supported. The VFS holds inode_lock and has checked
+ *              CAP_LINUX_IMMUTABLE.
+ * Returns:
+ *   - 0 on success.
+ *   - -EOPNOTSUPP for other flags or fsxattr fields.
+ *   - -ENOMEM if the map of a sealed file cannot be built.
+ */
+int osfs_fileattr_set(struct mnt_idmap *idmap, struct dentry *dentry, struct fileattr *fa)
+{
+    struct inode *inode = d_inode(dentry);
+    struct osfs_inode *osfs_inode = inode->i_private;
+    bool seal = fa->flags & FS_IMMUTABLE_FL;
+    int ret;
+
+    if (fileattr_has_fsx(fa) || (fa->flags & ~OSFS_FL_USER_MODIFIABLE))
+        return -EOPNOTSUPP;
+
+    if (seal != IS_IMMUTABLE(inode)) {
+        ret = osfs_seal_inode(inode, seal);
+        if (ret)
+            return ret;
+    }
+    osfs_inode->i_flags = (osfs_inode->i_flags & ~OSFS_FL_USER_MODIFIABLE) | fa->flags;
+    inode_set_ctime_current(inode);
+    inode_maybe_inc_iversion(inode, false);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+/**
+ * Function: osfs_read_folio
+ * Description: Fills a page cache folio of a sealed file for mmap. Folios
+ *              may be large; bytes past the end of the file are zeroed.
+ * Returns:
+ *   - 0 on success.
+ *   - -EIO if the file is no longer sealed.
+ */
+static int osfs_read_folio(struct file *file, struct folio *folio)
+{
+    struct inode *inode = folio->mapping->host;
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    const struct osfs_seal_map *map;
+    uint64_t pos = folio_pos(folio);
+    size_t off = 0, n;
+    void *addr, *dst;
+    int idx, ret = 0;
+
+    idx = srcu_read_lock(&osfs_seal_srcu);
+    map = srcu_dereference(OSFS_I(inode)->i_map, &osfs_seal_srcu);
+    if (!map) {
+        ret = -EIO;
+        goto out;
+    }
+    while (off < folio_size(folio) && pos + off < map->size) {
+        n = osfs_seal_span(sb_info, map, pos + off, &addr);
+        // kmap_local_folio() maps one page at a time
+        n = min3(n, folio_size(folio) - off, PAGE_SIZE - offset_in_page(off));
+        dst = kmap_local_folio(folio, off);
+        if (addr)
+            memcpy(dst, addr, n);
+        else
+            memset(dst, 0, n);
+        kunmap_local(dst);
+        off += n;
+    }
+    if (off < folio_size(folio))
+        folio_zero_segment(folio, off, folio_size(folio));
+    folio_mark_uptodate(folio);
+out:
+    srcu_read_unlock(&osfs_seal_srcu, idx);
+    folio_unlock(folio);
+    return ret;
+}
+
+const struct address_space_operations osfs_aops = {
+    .read_folio = osfs_read_folio,
+    .dirty_folio = noop_dirty_folio,  // The page cache only mirrors sealed blocks
+};
+
+static vm_fault_t osfs_sealed_fault(struct vm_fault *vmf)
+{
+    if (!IS_IMMUTABLE(file_inode(vmf->vma->vm_file)))
+        return VM_FAULT_SIGBUS;
+    return filemap_fault(vmf);
+}
+
+static const struct vm_operations_struct osfs_sealed_vm_ops = {
+    .fault = osfs_sealed_fault,
+    .map_pages = filemap_map_pages,
+    // No page_mkwrite: osfs_file_mmap() refuses writable shared mappings,
+    // so only private mappings can be written, and those copy on write
+};
+
+/**
+ * Function: osfs_file_mmap
+ * Description: mmap of a regular file, supported only while it is sealed.
+ *              A descriptor opened for writing before chattr +i must not
+ *              get a writable shared mapping, as memfd does for
+ *              F_SEAL_WRITE.
+ * Returns:
+ *   - 0 on success.
+ *   - -ENODEV if the file is not sealed.
+ *   - -EPERM for a writable shared mapping.
+ */
+int osfs_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (!IS_IMMUTABLE(file_inode(file)))
+        return -ENODEV;
+    if (vma->vm_flags & VM_SHARED) {
+        if (vma->vm_flags & VM_WRITE)
+            return -EPERM;
+        // Nor may mprotect() make it writable later
+        vm_flags_clear(vma, VM_MAYWRITE);
+    }
+    file_accessed(file);
+    vma->vm_ops = &osfs_sealed_vm_ops;
+    return 0;
+}
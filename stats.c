@@ -0,0 +1,127 @@
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include "osfs.h"
+
+/*
+ * Module-wide telemetry: per-CPU counters for every lock osfs takes and for
+ * the bitmap allocators. Updates are a this_cpu op on the fast path; the
+ * clock is only read while waiting for a contended lock and around an
+ * allocation. Readers sum over all CPUs without stopping the writers, so a
+ * snapshot may be slightly skewed between columns.
+ */
+DEFINE_PER_CPU(struct osfs_stats, osfs_stats);
+
+static const char * const osfs_lock_names[OSFS_LOCK_NR] = {
+    [OSFS_LOCK_DIR] = "dir",
+    [OSFS_LOCK_INODE] = "inode",
+    [OSFS_LOCK_ALLOC] = "alloc",
+    [OSFS_LOCK_POOL] = "pool",
+    [OSFS_LOCK_INSTANCE] = "instance",
+    [OSFS_LOCK_TRACE] = "trace",
+    [OSFS_LOCK_JOBS] = "jobs",
+    [OSFS_LOCK_DIRTY] = "dirty",
+};
+
+static const char * const osfs_alloc_names[OSFS_ALLOC_NR] = {
+    [OSFS_ALLOC_BLOCK] = "block",
+    [OSFS_ALLOC_INODE] = "inode",
+};
+
+/**
+ * Function: osfs_lockstat_show
+ * Description: One line per lock class: acquisitions, contended
+ *              acquisitions, total and average wait in nanoseconds.
+ */
+static int osfs_lockstat_show(struct seq_file *m, void *v)
+{
+    struct osfs_lock_stat sum;
+    int cls, cpu;
+
+    seq_puts(m, "# class acquired contended wait_ns avg_wait_ns\n");
+    for (cls = 0; cls < OSFS_LOCK_NR; cls++) {
+        memset(&sum, 0, sizeof(sum));
+        for_each_possible_cpu(cpu) {
+            struct osfs_lock_stat *s = &per_cpu(osfs_stats, cpu).lock[cls];
+
+            sum.acquired += READ_ONCE(s->acquired);
+            sum.contended += READ_ONCE(s->contended);
+            sum.wait_ns += READ_ONCE(s->wait_ns);
+        }
+        seq_printf(m, "%s %llu %llu %llu %llu\n", osfs_lock_names[cls], sum.acquired, sum.contended,
+                   sum.wait_ns, sum.contended ? div64_u64(sum.wait_ns, sum.contended) : 0);
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(osfs_lockstat);
+
+/**
+ * Function: osfs_allocstat_show
+ * Description: One line per allocator: calls, failures, bits scanned,
+ *              retries after losing a bit, and time spent, with per-call
+ *              averages of the last three.
+ */
+static int osfs_allocstat_show(struct seq_file *m, void *v)
+{
+    struct osfs_alloc_stat sum;
+    int cls, cpu;
+
+    seq_puts(m, "# allocator calls failed scanned retries time_ns avg_scanned avg_retries avg_ns\n");
+    for (cls = 0; cls < OSFS_ALLOC_NR; cls++) {
+        memset(&sum, 0, sizeof(sum));
+        for_each_possible_cpu(cpu) {
+            struct osfs_alloc_stat *s = &per_cpu(osfs_stats, cpu).alloc[cls];
+
+            sum.calls += READ_ONCE(s->calls);
+            sum.failed += READ_ONCE(s->failed);
+            sum.scanned += READ_ONCE(s->scanned);
+            sum.retries += READ_ONCE(s->retries);
+            sum.time_ns += READ_ONCE(s->time_ns);
+        }
+        seq_printf(m, "%s %llu %llu %llu %llu %llu", osfs_alloc_names[cls], sum.calls, sum.failed,
+                   sum.scanned, sum.retries, sum.time_ns);
+        if (sum.calls)
+            seq_printf(m, " %llu %llu %llu\n", div64_u64(sum.scanned, sum.calls),
+                       div64_u64(sum.retries, sum.calls), div64_u64(sum.time_ns, sum.calls));
+        else
+            seq_puts(m, " 0 0 0\n");
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(osfs_allocstat);
+
+/**
+ * Function: osfs_stats_reset_write
+ * Description: Clears all counters, e.g. between benchmark runs. Updates
+ *              racing with the reset may survive it.
+ */
+static ssize_t osfs_stats_reset_write(struct file *file, const char __user *buf,
+                                      size_t count, loff_t *ppos)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&osfs_stats, cpu), 0, sizeof(struct osfs_stats));
+    return count;
+}
+
+static const struct file_operations osfs_stats_reset_fops = {
+    .owner = THIS_MODULE,
+    .write = osfs_stats_reset_write,
+    .llseek = noop_llseek,
+};
+
+/**
+ * Function: osfs_stats_init
+ * Description: Creates the telemetry files under the osfs debugfs dir.
+ * Inputs:
+ *   - root: The osfs debugfs directory.
+ * Returns:
+ *   - None.
+ */
+void osfs_stats_init(struct dentry *root)
+{
+    debugfs_create_file("lockstat", 0400, root, NULL, &osfs_lockstat_fops);
+    debugfs_create_file("allocstat", 0400, root, NULL, &osfs_allocstat_fops);
+    debugfs_create_file("stats_reset", 0200, root, NULL, &osfs_stats_reset_fops);
+}
@@ -1,96 +1,348 @@
 #include <linux/fs.h>
 #include <linux/pagemap.h>
+#include <linux/parser.h>
+#include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/statfs.h>
 #include "osfs.h"
 
+static unsigned int flush_interval = 5;
+module_param(flush_interval, uint, 0644);
+MODULE_PARM_DESC(flush_interval, "Seconds between folds of dirty inode timestamps into the inode table");
+
 /**
- * Struct: osfs_super_ops
- * Description: Defines the superblock operations for the osfs filesystem.
+ * Function: osfs_dirty_inode
+ * Description: Queues an inode on the mount's dirty list the first time it
+ *              is dirtied after a fold. Timestamps are only kept in the VFS
+ *              inode until osfs_flush_inodes folds it.
+ * Inputs:
+ *   - inode: The inode being dirtied.
+ *   - flags: The I_DIRTY_* flags (unused).
+ * Returns:
+ *   - None.
  */
-const struct super_operations osfs_super_ops = {
-    .statfs = simple_statfs,            // Provides filesystem statistics
-    .drop_inode = generic_delete_inode, // Generic inode deletion
-    .destroy_inode = osfs_destroy_inode,
+static void osfs_dirty_inode(struct inode *inode, int flags)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode_info *oi = OSFS_I(inode);
 
-};
+    // Taken on every call, so the flush sees the stores that preceded it
+    osfs_spin_lock(&sb_info->dirty_lock, OSFS_LOCK_DIRTY);
+    if (list_empty(&oi->i_dirty))
+        list_add_tail(&oi->i_dirty, &sb_info->dirty_list);
+    spin_unlock(&sb_info->dirty_lock);
+}
 
-void osfs_destroy_inode(struct inode *inode)
+/**
+ * Function: osfs_flush_inodes
+ * Description: Folds the inodes on the dirty list into the inode table.
+ *              Only inodes dirtied since the last run are visited, not
+ *              every cached inode of the superblock.
+ * Inputs:
+ *   - sb: The superblock to flush.
+ * Returns:
+ *   - None.
+ */
+void osfs_flush_inodes(struct super_block *sb)
 {
-    if (inode->i_private) {
-        inode->i_private = NULL;
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct osfs_inode_info *oi;
+    struct inode *inode;
+
+    osfs_spin_lock(&sb_info->dirty_lock, OSFS_LOCK_DIRTY);
+    while ((oi = list_first_entry_or_null(&sb_info->dirty_list, struct osfs_inode_info, i_dirty))) {
+        list_del_init(&oi->i_dirty);
+        // NULL once eviction started, which folds the inode itself
+        inode = igrab(&oi->vfs_inode);
+        spin_unlock(&sb_info->dirty_lock);
+
+        // mark_inode_dirty() calls ->dirty_inode before it sets i_state,
+        // so fold directly: write_inode_now() may see a clean inode
+        if (inode) {
+            osfs_write_inode(inode, NULL);
+            iput(inode);
+        }
+
+        cond_resched();
+        osfs_spin_lock(&sb_info->dirty_lock, OSFS_LOCK_DIRTY);
     }
+    spin_unlock(&sb_info->dirty_lock);
 }
 
+/**
+ * Function: osfs_flush_job
+ * Description: Background job folding dirty inodes in one batch. Picks up
+ *              changes of flush_interval for the next run.
+ */
+bool osfs_flush_job(struct osfs_sb_info *sb_info, struct osfs_job *job)
+{
+    osfs_flush_inodes(sb_info->sb);
+    job->interval = max(flush_interval, 1U) * HZ;
+    return false;
+}
 
 /**
- * Function: osfs_fill_super
- * Description: Initializes the superblock with filesystem-specific information during mount.
+ * Function: osfs_sync_fs
+ * Description: sync(2)/syncfs(2) entry point. osfs has no backing device, so
+ *              the generic writeback passes skip it and dirty inodes are
+ *              folded here instead.
  * Inputs:
- *   - sb: The superblock to be filled.
- *   - data: Data passed during mount.
- *   - silent: If non-zero, suppress certain error messages.
+ *   - sb: The superblock to sync.
+ *   - wait: Whether the caller waits for completion (always synchronous).
  * Returns:
- *   - 0 on successful initialization.
- *   - A negative error code on failure.
+ *   - 0.
  */
-int osfs_fill_super(struct super_block *sb, void *data, int silent)
+static int osfs_sync_fs(struct super_block *sb, int wait)
 {
-    pr_info("osfs: Filling super start\n");
-    struct inode *root_inode;
-    struct osfs_sb_info *sb_info;
-    void *memory_region;
-    size_t total_memory_size;
+    osfs_flush_inodes(sb);
+    return 0;
+}
 
-    // Calculate total memory size required
-    total_memory_size = sizeof(struct osfs_sb_info) +
-                        INODE_BITMAP_SIZE * sizeof(unsigned long) +
-                        BLOCK_BITMAP_SIZE * sizeof(unsigned long) +
-                        FAT_SIZE +
-                        INODE_COUNT * sizeof(struct osfs_inode) +
-                        DATA_BLOCK_COUNT * BLOCK_SIZE;
+/**
+ * Function: osfs_remount_fs
+ * Description: Handles mount -o remount. Size options cannot change; a
+ *              base with overlays attached cannot become read-write.
+ * Inputs:
+ *   - sb: The superblock being remounted.
+ *   - flags: The new mount flags.
+ *   - data: Mount options (ignored).
+ * Returns:
+ *   - 0 on success.
+ *   - -EBUSY if overlays still share this mount.
+ */
+static int osfs_remount_fs(struct super_block *sb, int *flags, char *data)
+{
+    sync_filesystem(sb);
+    // i_version is always on and lazytime always off, as at mount
+    *flags |= SB_I_VERSION;
+    *flags &= ~SB_LAZYTIME;
+    return osfs_instance_remount(sb->s_fs_info, *flags & SB_RDONLY);
+}
 
-    // Allocate memory for superblock information and related structures
-    memory_region = vmalloc(total_memory_size);
-    if (!memory_region)
-        return -ENOMEM;
+/**
+ * Function: osfs_freeze_fs
+ * Description: Called by freeze_super() once new writers are blocked at
+ *              sb_start_write() and in-flight ones have drained, and after
+ *              sync_fs has folded dirty inodes. Parks the background jobs so
+ *              the inode table stays unchanged until thaw; readers are not
+ *              affected (atime updates are skipped while frozen).
+ * Inputs:
+ *   - sb: The superblock being frozen.
+ * Returns:
+ *   - 0.
+ */
+static int osfs_freeze_fs(struct super_block *sb)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
 
-    memset(memory_region, 0, total_memory_size);
+    osfs_jobs_stop(sb_info);
+    osfs_flush_inodes(sb);
+    return 0;
+}
 
-    // Initialize superblock information
-    sb_info = (struct osfs_sb_info *)memory_region;
-    sb_info->magic = OSFS_MAGIC;
-    sb_info->block_size = BLOCK_SIZE;
-    sb_info->inode_count = INODE_COUNT;
-    sb_info->block_count = DATA_BLOCK_COUNT;
-    sb_info->nr_free_inodes = INODE_COUNT - 1;
-    sb_info->nr_free_blocks = DATA_BLOCK_COUNT;
+/**
+ * Function: osfs_unfreeze_fs
+ * Description: Restarts the background jobs after a thaw.
+ */
+static int osfs_unfreeze_fs(struct super_block *sb)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
 
-    // Partition the memory region into respective components
-    sb_info->inode_bitmap = (unsigned long *)(sb_info + 1);
-    sb_info->block_bitmap = sb_info->inode_bitmap + INODE_BITMAP_SIZE;
-    sb_info->fat = (uint32_t *)(sb_info->block_bitmap + BLOCK_BITMAP_SIZE);
-    sb_info->inode_table = (void *)(sb_info->fat + FAT_SIZE);
-    sb_info->data_blocks = (void *)((char *)sb_info->inode_table +
-                                    INODE_COUNT * sizeof(struct osfs_inode));
+    osfs_jobs_resume(sb_info);
+    return 0;
+}
 
-    // Initialize bitmaps
-    memset(sb_info->inode_bitmap, 0, INODE_BITMAP_SIZE * sizeof(unsigned long));
-    memset(sb_info->block_bitmap, 0, BLOCK_BITMAP_SIZE * sizeof(unsigned long));
+/**
+ * Function: osfs_statfs
+ * Description: statfs(2) for one mount. f_blocks is the mount's blocks=
+ *              limit and f_bfree what is left of it; f_bavail is further
+ *              bounded by what the shared block pool can still supply.
+ * Inputs:
+ *   - dentry: Any dentry of the mount.
+ *   - buf: The statistics to fill in.
+ * Returns:
+ *   - 0.
+ */
+static int osfs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+    struct super_block *sb = dentry->d_sb;
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    uint64_t bfree = atomic_read(&sb_info->nr_free_blocks);
 
-    // Set superblock fields
-    sb->s_magic = sb_info->magic;
-    sb->s_fs_info = sb_info;
-    sb->s_op = &osfs_super_ops;
+    buf->f_type = sb->s_magic;
+    buf->f_bsize = BLOCK_SIZE;
+    buf->f_namelen = MAX_FILENAME_LEN - 1;
+    buf->f_blocks = sb_info->block_count - sb_info->shared_blocks;
+    buf->f_bfree = bfree;
+    buf->f_bavail = min(bfree, osfs_pool_avail(sb_info));
+    buf->f_files = sb_info->inode_count - 1;
+    buf->f_ffree = atomic_read(&sb_info->nr_free_inodes);
+    buf->f_fsid = u64_to_fsid(huge_encode_dev(sb->s_dev));
+    return 0;
+}
 
-    // Create root directory inode
-    root_inode = new_inode(sb);
-    if (!root_inode) {
-        vfree(memory_region);
+/**
+ * Struct: osfs_super_ops
+ * Description: Defines the superblock operations for the osfs filesystem.
+ */
+const struct super_operations osfs_super_ops = {
+    .statfs = osfs_statfs,              // Per-mount usage of the block pool
+    .drop_inode = generic_drop_inode,   // Unused linked inodes stay cached
+    .alloc_inode = osfs_alloc_inode,
+    .free_inode = osfs_free_inode,
+    .evict_inode = osfs_evict_inode,   // Frees storage of unlinked inodes
+    .dirty_inode = osfs_dirty_inode,   // Queues the inode for the flush job
+    .write_inode = osfs_write_inode,   // Folds timestamps into the inode table
+    .sync_fs = osfs_sync_fs,
+    .remount_fs = osfs_remount_fs,
+    .freeze_fs = osfs_freeze_fs,        // FIFREEZE: pause background work
+    .unfreeze_fs = osfs_unfreeze_fs,
+};
+
+
+enum {
+    Opt_inodes,
+    Opt_blocks,
+    Opt_reserve,
+    Opt_name,
+    Opt_base,
+    Opt_alloc_log,
+    Opt_alloc_first,
+    Opt_err,
+};
+
+static const match_table_t osfs_tokens = {
+    {Opt_inodes, "inodes=%u"},
+    {Opt_blocks, "blocks=%u"},
+    {Opt_reserve, "reserve=%u"},
+    {Opt_name, "name=%s"},
+    {Opt_base, "base=%s"},
+    {Opt_alloc_log, "alloc=log"},
+    {Opt_alloc_first, "alloc=first"},
+    {Opt_err, NULL},
+};
+
+/**
+ * Struct: osfs_mount_opts
+ * Description: Parsed mount options.
+ */
+struct osfs_mount_opts {
+    uint32_t inode_count;
+    uint32_t block_count;       // Block limit; private blocks of an overlay
+    uint32_t reserve;           // Blocks guaranteed by the pool
+    char *name;                 // Register the mount under this name
+    char *base;                 // Mount as an overlay of this instance
+    bool log;                   // alloc=log
+};
+
+static int osfs_parse_string(substring_t *arg, char **out, const char *opt)
+{
+    kfree(*out);
+    *out = match_strdup(arg);
+    if (!*out)
         return -ENOMEM;
+    if (!**out || strlen(*out) >= OSFS_NAME_LEN) {
+        pr_err("osfs: Invalid %s= value\n", opt);
+        return -EINVAL;
     }
+    return 0;
+}
+
+/**
+ * Function: osfs_parse_options
+ * Description: Parses the mount options "inodes=N", "blocks=N",
+ *              "reserve=N", "name=NAME", "base=NAME" and "alloc=log|first";
+ *              unset options keep the defaults.
+ * Inputs:
+ *   - options: The comma separated option string, may be NULL.
+ *   - opts: In/out, the parsed options. Strings are kmalloc'ed.
+ * Returns:
+ *   - 0 on success.
+ *   - -EINVAL on an unknown option or an out of range value.
+ */
+static int osfs_parse_options(char *options, struct osfs_mount_opts *opts)
+{
+    substring_t args[MAX_OPT_ARGS];
+    unsigned int value;
+    int ret;
+    char *p;
+
+    while (options && (p = strsep(&options, ",")) != NULL) {
+        if (!*p)
+            continue;
+        switch (match_token(p, osfs_tokens, args)) {
+        case Opt_inodes:
+            if (match_uint(&args[0], &value) || value < 2 || value > OSFS_MAX_BLOCKS) {
+                pr_err("osfs: Invalid inodes= value\n");
+                return -EINVAL;
+            }
+            opts->inode_count = value;
+            break;
+        case Opt_blocks:
+            if (match_uint(&args[0], &value) || value < 1 || value > OSFS_MAX_BLOCKS) {
+                pr_err("osfs: Invalid blocks= value\n");
+                return -EINVAL;
+            }
+            opts->block_count = value;
+            break;
+        case Opt_reserve:
+            if (match_uint(&args[0], &value) || value > OSFS_MAX_BLOCKS) {
+                pr_err("osfs: Invalid reserve= value\n");
+                return -EINVAL;
+            }
+            opts->reserve = value;
+            break;
+        case Opt_name:
+            ret = osfs_parse_string(&args[0], &opts->name, "name");
+            if (ret)
+                return ret;
+            break;
+        case Opt_base:
+            ret = osfs_parse_string(&args[0], &opts->base, "base");
+            if (ret)
+                return ret;
+            break;
+        case Opt_alloc_log:
+            opts->log = true;
+            break;
+        case Opt_alloc_first:
+            opts->log = false;
+            break;
+        default:
+            pr_err("osfs: Unknown mount option '%s'\n", p);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Function: osfs_make_root
+ * Description: Creates the root directory of a fresh filesystem.
+ * Inputs:
+ *   - sb: The superblock being filled.
+ * Returns:
+ *   - The root inode on success.
+ *   - ERR_PTR(-ENOMEM), ERR_PTR(-ENOSPC) or ERR_PTR(-EIO) on failure.
+ */
+static struct inode *osfs_make_root(struct super_block *sb)
+{
+    struct osfs_sb_info *sb_info = sb->s_fs_info;
+    struct osfs_inode *root_osfs_inode;
+    struct inode *root_inode;
+    int ret;
+
+    atomic_set(&sb_info->nr_free_inodes, sb_info->inode_count - 2);  // inode 0 is unused, 1 is the root
+    atomic_set(&sb_info->nr_free_blocks, sb_info->block_count);
+
+    // Create root directory inode
+    root_inode = new_inode(sb);
+    if (!root_inode)
+        return ERR_PTR(-ENOMEM);
 
     root_inode->i_ino = ROOT_INODE;
     root_inode->i_sb = sb;
+    insert_inode_hash(root_inode);
     root_inode->i_op = &osfs_dir_inode_operations;
     root_inode->i_fop = &osfs_dir_operations;
     root_inode->i_mode = S_IFDIR | 0755;
@@ -98,37 +350,213 @@ int osfs_fill_super(struct super_block *sb, void *data, int silent)
     simple_inode_init_ts(root_inode);
     
     // Initialize root directory's osfs_inode
-    struct osfs_inode *root_osfs_inode = osfs_get_osfs_inode(sb, ROOT_INODE);
+    root_osfs_inode = osfs_get_osfs_inode(sb, ROOT_INODE);
     if (!root_osfs_inode) {
         iput(root_inode);
-        vfree(memory_region);
-        return -EIO;
+        return ERR_PTR(-EIO);
     }
     memset(root_osfs_inode, 0, sizeof(*root_osfs_inode));
 
+    // Also takes the mount's first chunk from the pool
+    ret = osfs_alloc_data_block(sb_info, &root_osfs_inode->i_block);
+    if (ret) {
+        iput(root_inode);
+        return ERR_PTR(ret);
+    }
+    memset(osfs_block_addr(sb_info, root_osfs_inode->i_block), 0, BLOCK_SIZE);
+    osfs_place_dir_added(sb_info, root_osfs_inode->i_block);
+
     root_osfs_inode->i_ino = ROOT_INODE;
     root_osfs_inode->i_mode = root_inode->i_mode;
     root_osfs_inode->i_links_count = 2;
     root_osfs_inode->i_size = 0;
     root_osfs_inode->i_blocks = 1;      // one block for root directory
-    root_osfs_inode->i_block = 0;       // First data block
+    root_osfs_inode->i_xattr_block = OSFS_NO_BLOCK;
+    root_osfs_inode->i_parent = ROOT_INODE;
     root_osfs_inode->__i_atime = root_osfs_inode->__i_mtime = root_osfs_inode->__i_ctime = current_time(root_inode);
     root_inode->i_private = root_osfs_inode;
 
     // Mark root directory inode as used
     set_bit(ROOT_INODE, sb_info->inode_bitmap);
-    set_bit(0, sb_info->block_bitmap); // Mark the first data block as used
 
     // Update root directory size
     root_inode->i_size = 0;
+    root_inode->i_blocks = osfs_vfs_blocks(1);
     inode_init_owner(&nop_mnt_idmap, root_inode, NULL, root_inode->i_mode);
+    return root_inode;
+}
+
+/**
+ * Function: osfs_fill_super
+ * Description: Initializes the superblock with filesystem-specific information during mount.
+ * Inputs:
+ *   - sb: The superblock to be filled.
+ *   - data: Mount options, see osfs_parse_options.
+ *   - silent: If non-zero, suppress certain error messages.
+ * Returns:
+ *   - 0 on successful initialization.
+ *   - A negative error code on failure.
+ */
+int osfs_fill_super(struct super_block *sb, void *data, int silent)
+{
+    pr_info("osfs: Filling super start\n");
+    struct osfs_mount_opts opts = {
+        .inode_count = INODE_COUNT,
+        .block_count = DATA_BLOCK_COUNT,
+    };
+    struct inode *root_inode;
+    struct osfs_sb_info *sb_info, *base = NULL;
+    void *memory_region;
+    size_t total_memory_size, view_off, block_bitmap_off, fat_off, inode_table_off, chunks_off;
+    uint32_t inode_count, block_count, shared_blocks = 0;
+    int ret;
+
+    ret = osfs_parse_options(data, &opts);
+    if (ret)
+        goto out_opts;
+    inode_count = opts.inode_count;
+    if (opts.reserve > opts.block_count) {
+        pr_err("osfs: reserve= exceeds blocks=\n");
+        ret = -EINVAL;
+        goto out_opts;
+    }
+    // The type is FS_USERNS_MOUNT, but these reach past the new mount:
+    // name= and base= share an instance with other mounts, and reserve=
+    // commits the pool all mounts draw from
+    if ((opts.name || opts.base || opts.reserve) && !capable(CAP_SYS_ADMIN)) {
+        pr_err("osfs: name=, base= and reserve= need CAP_SYS_ADMIN in the initial user namespace\n");
+        ret = -EPERM;
+        goto out_opts;
+    }
+
+    // An overlay addresses the base's blocks first, then its own. The
+    // base is read-only, so its backed blocks are all it will ever have.
+    if (opts.base) {
+        base = osfs_get_base(opts.base);
+        if (IS_ERR(base)) {
+            ret = PTR_ERR(base);
+            goto out_opts;
+        }
+        inode_count = max(inode_count, base->inode_count);
+        shared_blocks = min_t(uint64_t, base->block_count, (uint64_t)base->nr_chunks << OSFS_CHUNK_SHIFT);
+        if (opts.block_count > OSFS_MAX_BLOCKS - shared_blocks) {
+            ret = -EINVAL;
+            goto out_base;
+        }
+    }
+    block_count = shared_blocks + opts.block_count;
+
+    // Lay out the metadata region: sb_info, inode bitmap, view header, block
+    // bitmap, the FAT of shared blocks, inode table and the chunk table.
+    // Data blocks come from the pool as they are allocated. The header,
+    // bitmap and FAT sit on pages of their own, which the layout views map
+    // to user space. Offsets are size_t so the region may exceed 4 GiB.
+    view_off = PAGE_ALIGN(sizeof(struct osfs_sb_info) + BITMAP_SIZE(inode_count) * sizeof(unsigned long));
+    block_bitmap_off = view_off + PAGE_SIZE;
+    fat_off = block_bitmap_off + PAGE_ALIGN(BITMAP_SIZE(block_count) * sizeof(unsigned long));
+    inode_table_off = fat_off + PAGE_ALIGN((size_t)shared_blocks * sizeof(uint32_t));
+    chunks_off = inode_table_off + (size_t)inode_count * sizeof(struct osfs_inode);
+    total_memory_size = chunks_off + DIV_ROUND_UP((size_t)opts.block_count, OSFS_CHUNK_BLOCKS) * sizeof(void *);
+
+    // Allocate memory for superblock information and related structures
+    memory_region = vzalloc(total_memory_size);
+    if (!memory_region) {
+        ret = -ENOMEM;
+        goto out_base;
+    }
+
+    // Initialize superblock information
+    sb_info = (struct osfs_sb_info *)memory_region;
+    sb_info->magic = OSFS_MAGIC;
+    sb_info->block_size = BLOCK_SIZE;
+    sb_info->inode_count = inode_count;
+    sb_info->block_count = block_count;
+    sb_info->sb = sb;
+    osfs_jobs_init(sb_info);
+    if (opts.log)
+        osfs_log_init(sb_info);
+    // Random start so handles from an earlier instance of the mount go stale
+    atomic_set(&sb_info->next_generation, get_random_u32());
+    refcount_set(&sb_info->refs, 1);
+    INIT_LIST_HEAD(&sb_info->instance);
+    spin_lock_init(&sb_info->dirty_lock);
+    INIT_LIST_HEAD(&sb_info->dirty_list);
+    sb_info->base = base;
+    sb_info->shared_blocks = shared_blocks;
+    mutex_init(&sb_info->chunk_lock);
+
+    // Partition the memory region into respective components
+    sb_info->inode_bitmap = (unsigned long *)(sb_info + 1);
+    sb_info->view = memory_region + view_off;
+    sb_info->block_bitmap = memory_region + block_bitmap_off;
+    sb_info->fat = memory_region + fat_off;
+    sb_info->inode_table = memory_region + inode_table_off;
+    sb_info->chunks = memory_region + chunks_off;
+    osfs_view_fill_header(sb_info);
+
+    // Set superblock fields. From here on osfs_kill_superblock releases
+    // sb_info and the base, so error paths below must not free them.
+    sb->s_magic = sb_info->magic;
+    sb->s_fs_info = sb_info;
+    sb->s_flags |= SB_I_VERSION;        // Change cookies for statx, NFS and OSFS_IOC_GETVERSION
+    // Timestamps are folded in batches anyway, and I_DIRTY_TIME alone
+    // would not reach osfs_dirty_inode()
+    sb->s_flags &= ~SB_LAZYTIME;
+    sb->s_op = &osfs_super_ops;
+    sb->s_max_links = OSFS_LINK_MAX;
+    sb->s_maxbytes = min_t(u64, MAX_LFS_FILESIZE, (u64)block_count * BLOCK_SIZE);
+    sb->s_xattr = osfs_xattr_handlers;
+    sb->s_export_op = &osfs_export_ops;
+
+    ret = osfs_pool_reserve(sb_info, opts.reserve);
+    if (ret)
+        goto out_opts;
+
+    ret = osfs_dindex_init(sb_info);
+    if (ret)
+        goto out_opts;
+
+    if (base) {
+        ret = osfs_overlay_load(sb_info);
+        if (ret)
+            goto out_opts;
+        root_inode = osfs_iget(sb, ROOT_INODE);
+    } else {
+        root_inode = osfs_make_root(sb);
+    }
+    if (IS_ERR(root_inode)) {
+        ret = PTR_ERR(root_inode);
+        goto out_opts;
+    }
+
     // Set the root directory
     sb->s_root = d_make_root(root_inode);
     if (!sb->s_root) {
-        iput(root_inode);
-        vfree(memory_region);
-        return -ENOMEM;
+        ret = -ENOMEM; // d_make_root() already dropped root_inode
+        goto out_opts;
     }
+
+    ret = osfs_register_instance(sb_info, opts.name);
+    if (ret)
+        goto out_opts;
+
+    osfs_view_register(sb_info);
+    osfs_jobs_register(sb_info);
+    osfs_log_register(sb_info);
+    sb_info->flush_job.name = "flush";
+    sb_info->flush_job.prio = OSFS_JOB_NORMAL;
+    sb_info->flush_job.interval = max(flush_interval, 1U) * HZ;
+    sb_info->flush_job.fn = osfs_flush_job;
+    osfs_job_add(sb_info, &sb_info->flush_job);
+    osfs_jobs_resume(sb_info);
     pr_info("osfs: Superblock filled successfully \n");
-    return 0;
+    goto out_opts;
+
+out_base:
+    if (base)
+        osfs_put_base(base);
+out_opts:
+    kfree(opts.name);
+    kfree(opts.base);
+    return ret;
 }
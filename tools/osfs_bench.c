@@ -0,0 +1,412 @@
+/*
+ * osfs_bench: multi-threaded metadata micro-benchmarks for osfs.
+ *
+ *   osfs_bench stat [-t max_threads] [-s seconds] [-n files] [-D] dir
+ *       Creates n files in dir, then stat()s them from 1, 2, 4 ... max_threads
+ *       threads and reports the aggregate rate and the scaling over one
+ *       thread. -D drops the dcache before each run, so the first pass over
+ *       the names goes through osfs_lookup (requires root).
+ *
+ *   osfs_bench negstat [-t max_threads] [-s seconds] [-n names] [-D] dir
+ *       stat()s n names that do not exist in dir. Reports the cold pass, in
+ *       which every miss reaches osfs_lookup, then the repeated misses that
+ *       the dcache answers from negative dentries.
+ *
+ *   osfs_bench create [-t max_threads] [-n files] dir
+ *       For each thread count, makes a fresh subdirectory and has the threads
+ *       create n distinct files in it between them, reporting creates/s.
+ *
+ *   osfs_bench read [-t max_threads] [-s seconds] [-n bytes] dir
+ *       Writes one file of n bytes and has every thread pread() it in full
+ *       through its own descriptor, the pattern of a hot config file.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct bench {
+    const char *dir;
+    int nfiles;
+    int seconds;
+    int max_threads;
+    int drop_caches;
+};
+
+struct worker {
+    pthread_t thread;
+    const struct bench *b;
+    const char *dir;
+    int id;
+    int count;
+    uint64_t ops;
+    uint64_t errors;
+};
+
+static volatile int stop;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void drop_dcache(void)
+{
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+
+    sync();
+    if (fd < 0 || write(fd, "2", 1) != 1)
+        perror("osfs_bench: drop_caches");
+    if (fd >= 0)
+        close(fd);
+}
+
+static void file_path(char *buf, size_t len, const char *dir, const char *prefix, int i)
+{
+    snprintf(buf, len, "%s/%s%d", dir, prefix, i);
+}
+
+static void *stat_worker(void *arg)
+{
+    struct worker *w = arg;
+    char path[4096];
+    struct stat st;
+    int i = w->id;
+
+    while (!stop) {
+        file_path(path, sizeof(path), w->b->dir, "f", i % w->b->nfiles);
+        if (stat(path, &st))
+            w->errors++;
+        w->ops++;
+        i++;
+    }
+    return NULL;
+}
+
+static void *negstat_worker(void *arg)
+{
+    struct worker *w = arg;
+    char path[4096];
+    struct stat st;
+    int i = w->id;
+
+    while (!stop) {
+        file_path(path, sizeof(path), w->b->dir, "missing", i % w->b->nfiles);
+        if (stat(path, &st) == 0 || errno != ENOENT)
+            w->errors++;
+        w->ops++;
+        i++;
+    }
+    return NULL;
+}
+
+/**
+ * Function: cold_negstat
+ * Description: Times the first failed stat() of every name, before any
+ *              negative dentry exists for it.
+ */
+static void cold_negstat(const struct bench *b)
+{
+    char path[4096];
+    struct stat st;
+    double start, elapsed;
+    int i;
+
+    if (b->drop_caches)
+        drop_dcache();
+    start = now_sec();
+    for (i = 0; i < b->nfiles; i++) {
+        file_path(path, sizeof(path), b->dir, "missing", i);
+        stat(path, &st);
+    }
+    elapsed = now_sec() - start;
+    printf("%-8s %8d %14.0f   (first miss of %d names)\n", "cold", 1, b->nfiles / elapsed, b->nfiles);
+}
+
+/**
+ * Function: run
+ * Description: Runs fn on nthreads threads for the configured duration.
+ * Returns:
+ *   - The aggregate operation rate per second.
+ */
+static double run(const struct bench *b, void *(*fn)(void *), int nthreads, uint64_t *errors)
+{
+    struct worker *w = calloc(nthreads, sizeof(*w));
+    uint64_t ops = 0;
+    double start, elapsed;
+    int i;
+
+    if (!w) {
+        fprintf(stderr, "osfs_bench: out of memory\n");
+        exit(1);
+    }
+    if (b->drop_caches)
+        drop_dcache();
+
+    stop = 0;
+    start = now_sec();
+    for (i = 0; i < nthreads; i++) {
+        w[i].b = b;
+        w[i].id = i * (b->nfiles / nthreads + 1);
+        if (pthread_create(&w[i].thread, NULL, fn, &w[i])) {
+            perror("osfs_bench: pthread_create");
+            exit(1);
+        }
+    }
+    sleep(b->seconds);
+    stop = 1;
+    *errors = 0;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(w[i].thread, NULL);
+        ops += w[i].ops;
+        *errors += w[i].errors;
+    }
+    elapsed = now_sec() - start;
+    free(w);
+    return ops / elapsed;
+}
+
+static void *read_worker(void *arg)
+{
+    struct worker *w = arg;
+    char path[4096];
+    char *buf = malloc(w->b->nfiles);
+    int fd;
+
+    file_path(path, sizeof(path), w->b->dir, "hot", 0);
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || !buf) {
+        perror(path);
+        exit(1);
+    }
+    while (!stop) {
+        if (pread(fd, buf, w->b->nfiles, 0) != w->b->nfiles)
+            w->errors++;
+        w->ops++;
+    }
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static int create_hot_file(const struct bench *b)
+{
+    char path[4096];
+    char *buf = malloc(b->nfiles);
+    int fd, ret = 0;
+
+    file_path(path, sizeof(path), b->dir, "hot", 0);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !buf) {
+        perror(path);
+        free(buf);
+        return -1;
+    }
+    memset(buf, 'x', b->nfiles);
+    if (write(fd, buf, b->nfiles) != b->nfiles) {
+        perror(path);
+        ret = -1;
+    }
+    close(fd);
+    free(buf);
+    return ret;
+}
+
+static void *create_worker(void *arg)
+{
+    struct worker *w = arg;
+    char path[4096];
+    int i, fd;
+
+    for (i = 0; i < w->count; i++) {
+        snprintf(path, sizeof(path), "%s/t%d_%d", w->dir, w->id, i);
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            w->errors++;
+            continue;
+        }
+        close(fd);
+        w->ops++;
+    }
+    return NULL;
+}
+
+/**
+ * Function: create_scale
+ * Description: Creates n files in one fresh directory from 1, 2, 4 ...
+ *              max_threads threads and prints the create rate.
+ */
+static int create_scale(const struct bench *b)
+{
+    char dir[4096];
+    double base = 0;
+    int t, i;
+
+    printf("%-8s %8s %14s %8s %8s\n", "bench", "threads", "creates/s", "scaling", "errors");
+    for (t = 1; t <= b->max_threads; t *= 2) {
+        struct worker *w = calloc(t, sizeof(*w));
+        uint64_t ops = 0, errors = 0;
+        double start, rate;
+
+        if (!w) {
+            fprintf(stderr, "osfs_bench: out of memory\n");
+            return -1;
+        }
+        snprintf(dir, sizeof(dir), "%s/create%d_%d", b->dir, t, (int)getpid());
+        if (mkdir(dir, 0755)) {
+            perror(dir);
+            free(w);
+            return -1;
+        }
+
+        start = now_sec();
+        for (i = 0; i < t; i++) {
+            w[i].b = b;
+            w[i].dir = dir;
+            w[i].id = i;
+            w[i].count = b->nfiles / t + (i < b->nfiles % t);
+            if (pthread_create(&w[i].thread, NULL, create_worker, &w[i])) {
+                perror("osfs_bench: pthread_create");
+                exit(1);
+            }
+        }
+        for (i = 0; i < t; i++) {
+            pthread_join(w[i].thread, NULL);
+            ops += w[i].ops;
+            errors += w[i].errors;
+        }
+        rate = ops / (now_sec() - start);
+        if (t == 1)
+            base = rate;
+        printf("%-8s %8d %14.0f %7.2fx %8llu\n", "create", t, rate, base ? rate / base : 0,
+               (unsigned long long)errors);
+        fflush(stdout);
+        free(w);
+    }
+    return 0;
+}
+
+static int create_files(const struct bench *b)
+{
+    char path[4096];
+    int i, fd;
+
+    for (i = 0; i < b->nfiles; i++) {
+        file_path(path, sizeof(path), b->dir, "f", i);
+        fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+/**
+ * Function: scale
+ * Description: Runs fn at 1, 2, 4 ... max_threads threads and prints the
+ *              rate at each step relative to the single-thread rate.
+ */
+static void scale(const struct bench *b, const char *what, void *(*fn)(void *))
+{
+    double base = 0;
+    int t;
+
+    printf("%-8s %8s %14s %8s %8s\n", "bench", "threads", "ops/s", "scaling", "errors");
+    for (t = 1; t <= b->max_threads; t *= 2) {
+        uint64_t errors;
+        double rate = run(b, fn, t, &errors);
+
+        if (t == 1)
+            base = rate;
+        printf("%-8s %8d %14.0f %7.2fx %8llu\n", what, t, rate, base ? rate / base : 0,
+               (unsigned long long)errors);
+        fflush(stdout);
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: osfs_bench stat    [-t max_threads] [-s seconds] [-n files] [-D] dir\n"
+            "       osfs_bench negstat [-t max_threads] [-s seconds] [-n names] [-D] dir\n"
+            "       osfs_bench create  [-t max_threads] [-n files] dir\n"
+            "       osfs_bench read    [-t max_threads] [-s seconds] [-n bytes] dir\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench b = {
+        .nfiles = 10,
+        .seconds = 3,
+        .max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+    };
+    const char *mode;
+    int opt;
+
+    if (argc < 2)
+        usage();
+    mode = argv[1];
+    optind = 2;
+
+    while ((opt = getopt(argc, argv, "t:s:n:D")) != -1) {
+        switch (opt) {
+        case 't':
+            b.max_threads = atoi(optarg);
+            break;
+        case 's':
+            b.seconds = atoi(optarg);
+            break;
+        case 'n':
+            b.nfiles = atoi(optarg);
+            break;
+        case 'D':
+            b.drop_caches = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1 || b.nfiles <= 0 || b.max_threads <= 0 || b.seconds <= 0)
+        usage();
+    b.dir = argv[optind];
+
+    if (strcmp(mode, "stat") == 0) {
+        if (create_files(&b))
+            return 1;
+        scale(&b, "stat", stat_worker);
+        return 0;
+    }
+
+    if (strcmp(mode, "negstat") == 0) {
+        cold_negstat(&b);
+        b.drop_caches = 0;  // keep the negative dentries from the cold pass
+        scale(&b, "negstat", negstat_worker);
+        return 0;
+    }
+
+    if (strcmp(mode, "create") == 0)
+        return create_scale(&b) ? 1 : 0;
+
+    if (strcmp(mode, "read") == 0) {
+        if (create_hot_file(&b))
+            return 1;
+        scale(&b, "read", read_worker);
+        return 0;
+    }
+
+    usage();
+    return 2;
+}
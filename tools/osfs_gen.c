@@ -0,0 +1,379 @@
+/*
+ * osfs_gen: deterministic, verifiable load generator for osfs.
+ *
+ * The byte stream produced for a given seed is split into 4KB blocks. Each
+ * block starts with a tag (magic, seed, stream offset, check word) followed
+ * by xorshift64* output seeded from (seed, offset), so every block can be
+ * regenerated and verified on its own. A mismatching block is decoded to
+ * report whether it holds data from another offset (misplaced block),
+ * another seed (stale data) or garbage.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GEN_BLOCK_SIZE 4096
+#define GEN_MAGIC 0x314e45475346534fULL   // "OSFSGEN1"
+#define GEN_CHUNK_BLOCKS 256              // 1MB per write/read call
+
+/**
+ * Struct: gen_tag
+ * Description: Header stored at the start of every generated block.
+ */
+struct gen_tag {
+    uint64_t magic;     // GEN_MAGIC
+    uint64_t seed;      // Seed of the stream
+    uint64_t offset;    // Stream offset of this block
+    uint64_t check;     // mix(seed ^ offset), detects torn tags
+};
+
+static uint64_t mix64(uint64_t x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * Function: gen_block
+ * Description: Generates the full content of the block at stream offset off.
+ * Inputs:
+ *   - seed: The stream seed.
+ *   - off: Block-aligned stream offset.
+ *   - buf: Output buffer of GEN_BLOCK_SIZE bytes.
+ */
+static void gen_block(uint64_t seed, uint64_t off, void *buf)
+{
+    struct gen_tag *tag = buf;
+    uint64_t *words = buf;
+    uint64_t x;
+    size_t i;
+
+    tag->magic = GEN_MAGIC;
+    tag->seed = seed;
+    tag->offset = off;
+    tag->check = mix64(seed ^ off);
+
+    x = mix64(seed + off) | 1;
+    for (i = sizeof(*tag) / sizeof(uint64_t); i < GEN_BLOCK_SIZE / sizeof(uint64_t); i++) {
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        words[i] = x * 0x2545f4914f6cdd1dULL;
+    }
+}
+
+/**
+ * Function: gen_range
+ * Description: Fills buf with stream bytes [off, off + len).
+ */
+static void gen_range(uint64_t seed, uint64_t off, void *buf, size_t len)
+{
+    static unsigned char block[GEN_BLOCK_SIZE];
+    unsigned char *out = buf;
+
+    while (len > 0) {
+        uint64_t base = off - off % GEN_BLOCK_SIZE;
+        size_t skip = off - base;
+        size_t n = GEN_BLOCK_SIZE - skip;
+
+        if (n > len)
+            n = len;
+        if (skip == 0 && n == GEN_BLOCK_SIZE) {
+            gen_block(seed, base, out);
+        } else {
+            gen_block(seed, base, block);
+            memcpy(out, block + skip, n);
+        }
+        out += n;
+        off += n;
+        len -= n;
+    }
+}
+
+/**
+ * Function: describe_block
+ * Description: Explains what a mismatching block actually contains.
+ * Inputs:
+ *   - seed: The expected seed.
+ *   - off: Block-aligned stream offset that was expected.
+ *   - data: The block as read back from the file.
+ *   - len: Number of valid bytes in data.
+ */
+static void describe_block(uint64_t seed, uint64_t off, const unsigned char *data, size_t len)
+{
+    struct gen_tag tag;
+    size_t i;
+
+    if (len < sizeof(tag)) {
+        fprintf(stderr, "  block is too short to carry a tag\n");
+        return;
+    }
+    memcpy(&tag, data, sizeof(tag));
+
+    if (tag.magic != GEN_MAGIC || tag.check != mix64(tag.seed ^ tag.offset)) {
+        for (i = 0; i < len && data[i] == 0; i++)
+            ;
+        if (i == len)
+            fprintf(stderr, "  block is all zeroes (hole or unwritten block)\n");
+        else
+            fprintf(stderr, "  block carries no generator tag (foreign data)\n");
+        return;
+    }
+    if (tag.seed != seed)
+        fprintf(stderr, "  block holds stale data from seed %" PRIu64 " offset %" PRIu64 "\n",
+                tag.seed, tag.offset);
+    else if (tag.offset != off)
+        fprintf(stderr, "  block is misplaced: it belongs at offset %" PRIu64 "\n", tag.offset);
+    else
+        fprintf(stderr, "  tag is intact, payload is corrupted\n");
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, uint64_t bytes, double secs)
+{
+    if (secs <= 0)
+        secs = 1e-9;
+    fprintf(stderr, "%s %" PRIu64 " bytes in %.3f s (%.1f MB/s)\n",
+            what, bytes, secs, bytes / secs / (1024 * 1024));
+}
+
+/**
+ * Function: do_gen
+ * Description: Writes stream bytes [off, off + len) to fd. Regular files are
+ *              written at the matching file offset, anything else is streamed.
+ */
+static int do_gen(int fd, uint64_t seed, uint64_t off, uint64_t len, int positioned)
+{
+    static unsigned char buf[GEN_CHUNK_BLOCKS * GEN_BLOCK_SIZE];
+    uint64_t done = 0;
+    double start = now_sec();
+
+    while (done < len) {
+        size_t n = sizeof(buf);
+        size_t put = 0;
+
+        // Keep writes block aligned so osfs sees whole-block updates
+        if ((off + done) % GEN_BLOCK_SIZE)
+            n = GEN_BLOCK_SIZE - (off + done) % GEN_BLOCK_SIZE;
+        if (n > len - done)
+            n = len - done;
+        gen_range(seed, off + done, buf, n);
+
+        while (put < n) {
+            ssize_t ret;
+
+            if (positioned)
+                ret = pwrite(fd, buf + put, n - put, off + done + put);
+            else
+                ret = write(fd, buf + put, n - put);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                perror("osfs_gen: write");
+                return 1;
+            }
+            put += ret;
+        }
+        done += n;
+    }
+    report("generated", done, now_sec() - start);
+    return 0;
+}
+
+/**
+ * Function: do_verify
+ * Description: Checks that fd holds stream bytes [off, off + len).
+ * Returns:
+ *   - 0 if the range matches, 1 on mismatch or error.
+ */
+static int do_verify(int fd, uint64_t seed, uint64_t off, uint64_t len)
+{
+    static unsigned char got[GEN_CHUNK_BLOCKS * GEN_BLOCK_SIZE];
+    static unsigned char want[GEN_CHUNK_BLOCKS * GEN_BLOCK_SIZE];
+    uint64_t done = 0;
+    uint64_t bad_blocks = 0;
+    double start = now_sec();
+
+    while (done < len) {
+        size_t n = sizeof(got);
+        size_t have = 0;
+        size_t i;
+
+        if ((off + done) % GEN_BLOCK_SIZE)
+            n = GEN_BLOCK_SIZE - (off + done) % GEN_BLOCK_SIZE;
+        if (n > len - done)
+            n = len - done;
+
+        while (have < n) {
+            ssize_t ret = pread(fd, got + have, n - have, off + done + have);
+
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                perror("osfs_gen: read");
+                return 1;
+            }
+            if (ret == 0)
+                break;
+            have += ret;
+        }
+        if (have < n) {
+            fprintf(stderr, "osfs_gen: short file, expected %" PRIu64 " bytes at offset %" PRIu64
+                    ", got %zu\n", (uint64_t)n, off + done, have);
+            return 1;
+        }
+
+        gen_range(seed, off + done, want, n);
+        if (memcmp(got, want, n) == 0) {
+            done += n;
+            continue;
+        }
+
+        // Report each mismatching block once, with its decoded tag
+        for (i = 0; i < n; ) {
+            uint64_t pos = off + done + i;
+            uint64_t base = pos - pos % GEN_BLOCK_SIZE;
+            size_t span = GEN_BLOCK_SIZE - (pos - base);
+
+            if (span > n - i)
+                span = n - i;
+            if (memcmp(got + i, want + i, span)) {
+                fprintf(stderr, "osfs_gen: mismatch in block at offset %" PRIu64 "\n", base);
+                if (pos == base)
+                    describe_block(seed, base, got + i, span);
+                bad_blocks++;
+            }
+            i += span;
+        }
+        done += n;
+    }
+
+    if (bad_blocks) {
+        fprintf(stderr, "osfs_gen: %" PRIu64 " bad blocks\n", bad_blocks);
+        return 1;
+    }
+    report("verified", done, now_sec() - start);
+    return 0;
+}
+
+static uint64_t parse_size(const char *s)
+{
+    char *end;
+    uint64_t v = strtoull(s, &end, 0);
+
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (*end) {
+        fprintf(stderr, "osfs_gen: invalid size '%s'\n", s);
+        exit(2);
+    }
+    return v;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: osfs_gen gen    [-s seed] [-o offset] -n bytes [file]\n"
+            "       osfs_gen verify [-s seed] [-o offset] [-n bytes] file\n"
+            "Sizes accept K/M/G suffixes. gen writes to stdout without a file.\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t seed = 1, off = 0, len = 0;
+    int have_len = 0;
+    const char *mode, *path = NULL;
+    int opt, fd, ret;
+
+    if (argc < 2)
+        usage();
+    mode = argv[1];
+    optind = 2;
+
+    while ((opt = getopt(argc, argv, "s:o:n:")) != -1) {
+        switch (opt) {
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            off = parse_size(optarg);
+            break;
+        case 'n':
+            len = parse_size(optarg);
+            have_len = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    if (strcmp(mode, "gen") == 0) {
+        if (!have_len)
+            usage();
+        if (!path)
+            return do_gen(STDOUT_FILENO, seed, off, len, 0);
+        fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+        ret = do_gen(fd, seed, off, len, 1);
+        if (close(fd) && !ret) {
+            perror(path);
+            ret = 1;
+        }
+        return ret;
+    }
+
+    if (strcmp(mode, "verify") == 0) {
+        struct stat st;
+
+        if (!path)
+            usage();
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+        if (!have_len) {
+            if (fstat(fd, &st)) {
+                perror(path);
+                close(fd);
+                return 1;
+            }
+            len = (uint64_t)st.st_size > off ? st.st_size - off : 0;
+        }
+        ret = do_verify(fd, seed, off, len);
+        close(fd);
+        return ret;
+    }
+
+    usage();
+    return 2;
+}
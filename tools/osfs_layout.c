@@ -0,0 +1,180 @@
+/*
+ * osfs_layout: capacity and fragmentation report for one osfs mount, read
+ * from its layout views in debugfs without a single ioctl.
+ *
+ *   osfs_layout /sys/kernel/debug/osfs/mounts/0:42
+ *
+ * The header, block bitmap and FAT are mapped and copied under the
+ * seq_begin/seq_end protocol of struct osfs_view_header, so the report is
+ * computed from one consistent snapshot even while the mount is busy.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../osfs_uapi.h"
+
+#define SNAPSHOT_TRIES 1000
+
+struct view {
+    void *addr;
+    size_t size;
+};
+
+static int map_view(const char *dir, const char *name, struct view *v)
+{
+    char path[4096];
+    struct stat st;
+    long page = sysconf(_SC_PAGESIZE);
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    // debugfs reports size 0; map what the header says, rounded to pages
+    if (fstat(fd, &st) == 0 && st.st_size)
+        v->size = st.st_size;
+    v->size = (v->size + page - 1) / page * page;
+    v->addr = mmap(NULL, v->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (v->addr == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int test_bit(const uint8_t *bitmap, uint32_t bit)
+{
+    return (bitmap[bit / 8] >> (bit % 8)) & 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct view header = { .size = 1 }, bitmap = { 0 }, fat = { 0 }, inodes = { 0 };
+    const volatile struct osfs_view_header *h;
+    uint8_t *bits;
+    uint32_t *entries;
+    struct osfs_view_inode *in;
+    uint64_t seq, used = 0, free_runs = 0, run = 0, max_run = 0, files = 0, breaks = 0, chained = 0;
+    uint64_t placed = 0, near = 0;
+    uint32_t parent;
+    size_t bitmap_bytes;
+    uint32_t b, ino, i, blocks;
+    int tries;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s /sys/kernel/debug/osfs/mounts/<dev>\n", argv[0]);
+        return 2;
+    }
+    if (map_view(argv[1], "header", &header))
+        return 1;
+    h = header.addr;
+    if (h->magic != 0x051AB520) {
+        fprintf(stderr, "%s: not an osfs view\n", argv[1]);
+        return 1;
+    }
+
+    bitmap.size = ((size_t)h->block_count + 63) / 64 * 8;
+    fat.size = h->fat_chunk_offset +
+               ((size_t)(h->block_count - h->shared_blocks) + h->chunk_blocks - 1) / h->chunk_blocks * h->fat_stride;
+    inodes.size = (size_t)h->inode_count * sizeof(struct osfs_view_inode);
+    if (map_view(argv[1], "block_bitmap", &bitmap) || map_view(argv[1], "fat", &fat) ||
+        map_view(argv[1], "inodes", &inodes))
+        return 1;
+    in = inodes.addr;
+
+    bitmap_bytes = ((size_t)h->block_count + 7) / 8;
+    bits = malloc(bitmap_bytes);
+    entries = calloc(h->block_count, sizeof(uint32_t));
+    if (!bits || !entries) {
+        perror("malloc");
+        return 1;
+    }
+
+    for (tries = 0; tries < SNAPSHOT_TRIES; tries++) {
+        uint32_t c, nr_chunks;
+        uint64_t begin;
+
+        seq = __atomic_load_n(&h->seq_end, __ATOMIC_ACQUIRE);
+        begin = __atomic_load_n(&h->seq_begin, __ATOMIC_ACQUIRE);
+        nr_chunks = h->nr_chunks;
+        memcpy(bits, bitmap.addr, bitmap_bytes);
+        memcpy(entries, fat.addr, (size_t)h->shared_blocks * sizeof(uint32_t));
+        // Only the backed chunks of fat may be touched, the rest faults
+        for (c = 0; c < nr_chunks; c++) {
+            size_t first = h->shared_blocks + (size_t)c * h->chunk_blocks;
+            size_t n = h->block_count - first < h->chunk_blocks ? h->block_count - first : h->chunk_blocks;
+
+            memcpy(entries + first, (char *)fat.addr + h->fat_chunk_offset + (size_t)c * h->fat_stride,
+                   n * sizeof(uint32_t));
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (begin == seq && h->seq_begin == seq)
+            break;
+    }
+    if (tries == SNAPSHOT_TRIES)
+        fprintf(stderr, "warning: mount too busy for a consistent snapshot\n");
+
+    for (b = 0; b < h->block_count; b++) {
+        if (test_bit(bits, b)) {
+            used++;
+            if (run) {
+                free_runs++;
+                max_run = run > max_run ? run : max_run;
+                run = 0;
+            }
+        } else {
+            run++;
+        }
+    }
+    if (run) {
+        free_runs++;
+        max_run = run > max_run ? run : max_run;
+    }
+
+    // Contiguity: how often a file's next block is not the adjacent one
+    for (ino = 1; ino < h->inode_count; ino++) {
+        if (!in[ino].mode || !S_ISREG(in[ino].mode) || !in[ino].blocks)
+            continue;
+        files++;
+        blocks = in[ino].blocks;
+        b = in[ino].first_block;
+        // Locality: does the file start in its directory's chunk?
+        parent = in[ino].parent;
+        if (parent && parent < h->inode_count && S_ISDIR(in[parent].mode) && in[parent].blocks &&
+            b >= h->shared_blocks && in[parent].first_block >= h->shared_blocks) {
+            placed++;
+            if ((b - h->shared_blocks) / h->chunk_blocks ==
+                (in[parent].first_block - h->shared_blocks) / h->chunk_blocks)
+                near++;
+        }
+        for (i = 1; i < blocks && b < h->block_count; i++, chained++) {
+            if (entries[b] != b + 1)
+                breaks++;
+            b = entries[b];
+        }
+    }
+
+    printf("blocks        %" PRIu32 " of %" PRIu32 " bytes (%" PRIu32 " shared)\n",
+           h->block_count, h->block_size, h->shared_blocks);
+    printf("backed        %" PRIu32 " chunks of %" PRIu32 " blocks\n", h->nr_chunks, h->chunk_blocks);
+    printf("used          %" PRIu64 " (%.1f%%)\n", used, h->block_count ? 100.0 * used / h->block_count : 0.0);
+    printf("free runs     %" PRIu64 ", largest %" PRIu64 "\n", free_runs, max_run);
+    printf("files         %" PRIu64 ", %.2f%% of block links non-contiguous\n",
+           files, chained ? 100.0 * breaks / chained : 0.0);
+    printf("locality      %.2f%% of files start in their directory's chunk\n",
+           placed ? 100.0 * near / placed : 0.0);
+    printf("snapshot      seq %" PRIu64 ", %d retries\n", seq, tries);
+    return 0;
+}
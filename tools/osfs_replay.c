@@ -0,0 +1,702 @@
+/*
+ * osfs_replay: re-issues an op stream captured from osfs/trace against a
+ * fresh mount and reports throughput and latency percentiles.
+ *
+ * Capture:
+ *   echo 1 > /sys/kernel/debug/osfs/trace_enable
+ *   cat /sys/kernel/debug/osfs/trace > ops.trace     (Ctrl-C to stop)
+ *   echo 0 > /sys/kernel/debug/osfs/trace_enable
+ * Replay:
+ *   osfs_replay [-t] [-d dev] ops.trace /path/to/fresh/mount
+ *
+ * Names are not captured, only their hash, so entries are recreated as
+ * "n<hash>" under the replayed parent. Inodes that existed before capture
+ * started are recreated up front (untimed) at "i<ino>" / "d<ino>" in the
+ * mount root, or at their looked-up name when the parent is known, sized
+ * to cover every read in the trace. Each inode is tracked by its parent
+ * and name rather than by path, so renamed directories carry their
+ * subtrees along; of a file with several links, the name it was created
+ * or last linked under is used.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../osfs_uapi.h"
+
+#define ROOT_INO 1
+#define TYPE_DIR (S_IFDIR >> 12)
+#define OP_MAX (OSFS_TRACE_RMDIR + 1)
+
+/**
+ * Struct: node
+ * Description: Replay-side state of one captured inode.
+ */
+struct node {
+    uint32_t ino;
+    int type;           // S_IFMT >> 12, 0 until known
+    int exists;         // Present in the replay mount
+    int prep;           // Existed before capture, recreate before timing
+    uint64_t size;      // Bytes needed to satisfy every traced read
+    uint32_t parent;    // Parent directory inode, 0 until placed
+    char name[16];      // Entry name under parent
+    uint32_t link_parent;   // Another name of the file, if linked
+    char link_name[16];
+    int fd;
+};
+
+struct op_stats {
+    uint64_t *lat;
+    size_t count;
+    size_t cap;
+    uint64_t errors;
+    uint64_t bytes;
+};
+
+static const char *op_names[OP_MAX] = {
+    [OSFS_TRACE_LOOKUP] = "lookup",
+    [OSFS_TRACE_CREATE] = "create",
+    [OSFS_TRACE_MKDIR] = "mkdir",
+    [OSFS_TRACE_READ] = "read",
+    [OSFS_TRACE_WRITE] = "write",
+    [OSFS_TRACE_RENAME] = "rename",
+    [OSFS_TRACE_LINK] = "link",
+    [OSFS_TRACE_UNLINK] = "unlink",
+    [OSFS_TRACE_RMDIR] = "rmdir",
+};
+
+static struct node **nodes;
+static size_t nodes_cap;
+static size_t nodes_used;
+static const char *mount_dir;
+
+static void *xmalloc(size_t n)
+{
+    void *p = malloc(n);
+
+    if (!p) {
+        fprintf(stderr, "osfs_replay: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/**
+ * Function: node_get
+ * Description: Finds or adds the node of ino. Nodes are allocated one by
+ *              one, so returned pointers stay valid across table growth.
+ */
+static struct node *node_get(uint32_t ino)
+{
+    struct node *n;
+    size_t i;
+
+    if (2 * (nodes_used + 1) > nodes_cap) {
+        struct node **old = nodes;
+        size_t old_cap = nodes_cap;
+
+        nodes_cap = nodes_cap ? nodes_cap * 2 : 1024;
+        nodes = calloc(nodes_cap, sizeof(*nodes));
+        if (!nodes) {
+            fprintf(stderr, "osfs_replay: out of memory\n");
+            exit(1);
+        }
+        for (i = 0; i < old_cap; i++) {
+            if (old[i]) {
+                size_t k = old[i]->ino * 2654435761u & (nodes_cap - 1);
+
+                while (nodes[k])
+                    k = (k + 1) & (nodes_cap - 1);
+                nodes[k] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    for (i = ino * 2654435761u & (nodes_cap - 1); nodes[i]; i = (i + 1) & (nodes_cap - 1))
+        if (nodes[i]->ino == ino)
+            return nodes[i];
+
+    n = xmalloc(sizeof(*n));
+    memset(n, 0, sizeof(*n));
+    n->ino = ino;
+    n->fd = -1;
+    nodes[i] = n;
+    nodes_used++;
+    return n;
+}
+
+/**
+ * Function: node_place
+ * Description: Gives a node the entry "n<hash>" in directory dir.
+ */
+static void node_place(struct node *n, uint32_t dir, uint32_t hash)
+{
+    n->parent = dir;
+    snprintf(n->name, sizeof(n->name), "n%08x", hash);
+}
+
+static int name_is(uint32_t parent, const char *name, uint32_t dir, uint32_t hash)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "n%08x", hash);
+    return parent == dir && !strcmp(name, buf);
+}
+
+static int node_is(const struct node *n, uint32_t dir, uint32_t hash)
+{
+    return name_is(n->parent, n->name, dir, hash);
+}
+
+/**
+ * Function: node_known
+ * Description: Returns the node of ino, placing inodes that were never
+ *              seen being named at a root-level placeholder to be
+ *              recreated before the replay.
+ */
+static struct node *node_known(uint32_t ino, int type)
+{
+    struct node *n = node_get(ino);
+
+    if (type && !n->type)
+        n->type = type;
+    if (ino == ROOT_INO) {
+        n->type = TYPE_DIR;
+        n->exists = 1;
+    } else if (!n->parent) {
+        n->parent = ROOT_INO;
+        snprintf(n->name, sizeof(n->name), n->type == TYPE_DIR ? "d%u" : "i%u", ino);
+        n->prep = 1;
+    }
+    return n;
+}
+
+/**
+ * Function: node_path
+ * Description: Builds the current replay path of ino from its ancestors.
+ * Returns:
+ *   - The length of the path, or -1 if it does not fit.
+ */
+static int node_path(uint32_t ino, char *buf, size_t size)
+{
+    struct node *n;
+    int len;
+
+    if (ino == ROOT_INO) {
+        len = snprintf(buf, size, "%s", mount_dir);
+        return len < (int)size ? len : -1;
+    }
+    n = node_known(ino, 0);
+    len = node_path(n->parent, buf, size);
+    if (len < 0 || len + 1 + strlen(n->name) >= size)
+        return -1;
+    return len + sprintf(buf + len, "/%s", n->name);
+}
+
+static int child_path(uint32_t dir, uint32_t hash, char *buf, size_t size)
+{
+    int len = node_path(dir, buf, size);
+
+    if (len < 0 || len + 10 >= (int)size)
+        return -1;
+    return len + sprintf(buf + len, "/n%08x", hash);
+}
+
+/**
+ * Function: plan_named
+ * Description: Places a node first seen through a name: it predates the
+ *              capture, so it is recreated there before the replay.
+ */
+static struct node *plan_named(uint32_t ino, uint32_t dir, uint32_t hash, int type)
+{
+    struct node *n = node_get(ino);
+
+    if (!n->parent && ino != ROOT_INO) {
+        node_place(n, dir, hash);
+        n->prep = 1;
+    }
+    if (!n->type)
+        n->type = type;
+    return n;
+}
+
+/**
+ * Function: plan
+ * Description: Walks the trace once to find inodes that existed before
+ *              capture, where they were and the size each of them needs.
+ */
+static void plan(const struct osfs_trace_rec *recs, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        const struct osfs_trace_rec *r = &recs[i];
+        struct node *n;
+
+        switch (r->op) {
+        case OSFS_TRACE_LOOKUP:
+        case OSFS_TRACE_UNLINK:
+        case OSFS_TRACE_RMDIR:
+            if (r->ret || !r->ino)
+                break;
+            plan_named(r->ino, r->dir, r->name_hash, r->type);
+            break;
+        case OSFS_TRACE_CREATE:
+        case OSFS_TRACE_MKDIR:
+            if (r->ret || !r->ino)
+                break;
+            n = node_get(r->ino);
+            if (!n->parent)
+                node_place(n, r->dir, r->name_hash);
+            n->type = r->type;
+            break;
+        case OSFS_TRACE_RENAME:
+            if (r->ret)
+                break;
+            plan_named(r->ino, r->dir, r->name_hash, r->type);
+            // The type of a replaced inode is not recorded; assume the source's
+            if (OSFS_TRACE_RENAME_INO(r->offset))
+                plan_named(OSFS_TRACE_RENAME_INO(r->offset), OSFS_TRACE_RENAME_DIR(r->offset), r->len, r->type);
+            break;
+        case OSFS_TRACE_READ:
+            n = node_known(r->ino, r->type);
+            if (n->prep && r->ret > 0 && r->offset + r->ret > n->size)
+                n->size = r->offset + r->ret;
+            break;
+        case OSFS_TRACE_WRITE:
+        case OSFS_TRACE_LINK:
+            node_known(r->ino, r->type);
+            break;
+        }
+    }
+}
+
+/**
+ * Function: prep_one
+ * Description: Recreates one pre-existing inode, and its parent first.
+ */
+static int prep_one(struct node *n)
+{
+    static char zero[65536];
+    char path[PATH_MAX];
+    uint64_t done = 0;
+    struct node *p;
+    int fd;
+
+    p = node_get(n->parent);
+    if (p->prep && !p->exists && prep_one(p))
+        return -1;
+    if (node_path(n->ino, path, sizeof(path)) < 0) {
+        fprintf(stderr, "osfs_replay: path of inode %u too long\n", n->ino);
+        return -1;
+    }
+
+    if (n->type == TYPE_DIR) {
+        if (mkdir(path, 0755) && errno != EEXIST) {
+            perror(path);
+            return -1;
+        }
+        n->exists = 1;
+        return 0;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    while (done < n->size) {
+        size_t len = n->size - done < sizeof(zero) ? n->size - done : sizeof(zero);
+        ssize_t ret = pwrite(fd, zero, len, done);
+
+        if (ret <= 0) {
+            perror(path);
+            close(fd);
+            return -1;
+        }
+        done += ret;
+    }
+    n->fd = fd;
+    n->exists = 1;
+    return 0;
+}
+
+/**
+ * Function: prep
+ * Description: Recreates pre-existing inodes, parents before children.
+ */
+static int prep(void)
+{
+    size_t i;
+
+    for (i = 0; i < nodes_cap; i++) {
+        struct node *n = nodes[i];
+
+        if (n && n->prep && !n->exists && prep_one(n))
+            return -1;
+    }
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stats_add(struct op_stats *s, uint64_t lat)
+{
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4096;
+        s->lat = realloc(s->lat, s->cap * sizeof(*s->lat));
+        if (!s->lat) {
+            fprintf(stderr, "osfs_replay: out of memory\n");
+            exit(1);
+        }
+    }
+    s->lat[s->count++] = lat;
+}
+
+static int file_fd(struct node *n)
+{
+    char path[PATH_MAX];
+
+    if (n->fd < 0 && node_path(n->ino, path, sizeof(path)) >= 0)
+        n->fd = open(path, O_RDWR);
+    return n->fd;
+}
+
+/**
+ * Function: node_unname
+ * Description: Drops the name dir/hash of a node after an unlink, rmdir or
+ *              replacing rename. A file that has another link moves to it.
+ */
+static void node_unname(struct node *n, uint32_t dir, uint32_t hash)
+{
+    if (name_is(n->link_parent, n->link_name, dir, hash)) {
+        n->link_parent = 0;
+    } else if (node_is(n, dir, hash)) {
+        if (n->link_parent) {
+            n->parent = n->link_parent;
+            memcpy(n->name, n->link_name, sizeof(n->name));
+            n->link_parent = 0;
+        } else {
+            n->exists = 0;
+        }
+    }
+}
+
+/**
+ * Function: replay_ns
+ * Description: Issues one rename, link, unlink or rmdir and updates the
+ *              replayed namespace.
+ * Returns:
+ *   - 0 if the op succeeded or failed as it did when traced, -1 otherwise.
+ */
+static int replay_ns(const struct osfs_trace_rec *r, uint64_t *lat)
+{
+    char path[PATH_MAX], target[PATH_MAX];
+    struct node *n = r->ino ? node_get(r->ino) : NULL, *other;
+    uint32_t dir = r->dir, hash = r->name_hash;
+    uint64_t t0;
+    int ret;
+
+    if (child_path(r->dir, r->name_hash, path, sizeof(path)) < 0)
+        return -1;
+    switch (r->op) {
+    case OSFS_TRACE_RENAME:
+        dir = OSFS_TRACE_RENAME_DIR(r->offset);
+        hash = r->len;
+        if (child_path(dir, hash, target, sizeof(target)) < 0)
+            return -1;
+        t0 = now_ns();
+        ret = renameat2(AT_FDCWD, path, AT_FDCWD, target, r->flags);
+        break;
+    case OSFS_TRACE_LINK:
+        // The traced name is the new one; link from wherever the file is now
+        memcpy(target, path, sizeof(path));
+        if (!n || node_path(n->ino, path, sizeof(path)) < 0)
+            return -1;
+        t0 = now_ns();
+        ret = link(path, target);
+        break;
+    case OSFS_TRACE_UNLINK:
+        t0 = now_ns();
+        ret = unlink(path);
+        break;
+    default:
+        t0 = now_ns();
+        ret = rmdir(path);
+        break;
+    }
+    *lat = now_ns() - t0;
+
+    // A traced failure is expected to fail again
+    if (r->ret)
+        return ret ? 0 : -1;
+    if (ret || !n)
+        return -1;
+
+    switch (r->op) {
+    case OSFS_TRACE_RENAME:
+        other = OSFS_TRACE_RENAME_INO(r->offset) ? node_get(OSFS_TRACE_RENAME_INO(r->offset)) : NULL;
+        if (other && (r->flags & RENAME_EXCHANGE))
+            node_place(other, r->dir, r->name_hash);
+        else if (other)
+            node_unname(other, dir, hash);
+        if (node_is(n, r->dir, r->name_hash)) {
+            node_place(n, dir, hash);
+        } else {
+            // A secondary link of the file was renamed
+            n->link_parent = dir;
+            snprintf(n->link_name, sizeof(n->link_name), "n%08x", hash);
+        }
+        break;
+    case OSFS_TRACE_LINK:
+        n->link_parent = dir;
+        snprintf(n->link_name, sizeof(n->link_name), "n%08x", hash);
+        break;
+    default:
+        node_unname(n, dir, hash);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * Function: replay_one
+ * Description: Issues one record against the mount.
+ * Returns:
+ *   - Bytes transferred for read/write, 0 for namespace ops, -1 on error.
+ */
+static ssize_t replay_one(const struct osfs_trace_rec *r, char *buf, uint64_t *lat)
+{
+    char path[PATH_MAX];
+    struct node *n;
+    struct stat st;
+    uint64_t t0;
+    ssize_t ret = 0;
+    int fd;
+
+    switch (r->op) {
+    case OSFS_TRACE_LOOKUP:
+        if (r->ret == 0 && r->ino)
+            ret = node_path(r->ino, path, sizeof(path));
+        else
+            ret = child_path(r->dir, r->name_hash, path, sizeof(path));
+        if (ret < 0)
+            return -1;
+        t0 = now_ns();
+        ret = stat(path, &st);
+        *lat = now_ns() - t0;
+        // a traced miss is expected to miss again
+        return (ret == 0) == (r->ret == 0) ? 0 : -1;
+    case OSFS_TRACE_CREATE:
+    case OSFS_TRACE_MKDIR:
+        if (r->ret || !r->ino) {
+            if (child_path(r->dir, r->name_hash, path, sizeof(path)) < 0)
+                return -1;
+            t0 = now_ns();
+            ret = r->op == OSFS_TRACE_MKDIR ? mkdir(path, 0755) : open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+            *lat = now_ns() - t0;
+            if (r->op == OSFS_TRACE_CREATE && ret >= 0)
+                close(ret);
+            return ret < 0 ? 0 : -1;
+        }
+        // The inode number may be reused after an unlink
+        n = node_get(r->ino);
+        if (n->fd >= 0)
+            close(n->fd);
+        n->fd = -1;
+        n->link_parent = 0;
+        n->type = r->type;
+        node_place(n, r->dir, r->name_hash);
+        if (node_path(n->ino, path, sizeof(path)) < 0)
+            return -1;
+        t0 = now_ns();
+        if (r->op == OSFS_TRACE_MKDIR)
+            ret = mkdir(path, 0755);
+        else
+            ret = n->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        *lat = now_ns() - t0;
+        n->exists = ret >= 0;
+        return ret < 0 ? -1 : 0;
+    case OSFS_TRACE_READ:
+    case OSFS_TRACE_WRITE:
+        fd = file_fd(node_get(r->ino));
+        if (fd < 0)
+            return -1;
+        t0 = now_ns();
+        if (r->op == OSFS_TRACE_READ)
+            ret = pread(fd, buf, r->len, r->offset);
+        else
+            ret = pwrite(fd, buf, r->len, r->offset);
+        *lat = now_ns() - t0;
+        return ret;
+    case OSFS_TRACE_RENAME:
+    case OSFS_TRACE_LINK:
+    case OSFS_TRACE_UNLINK:
+    case OSFS_TRACE_RMDIR:
+        return replay_ns(r, lat);
+    }
+    return -1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double pct(const struct op_stats *s, double p)
+{
+    size_t i = (size_t)(p / 100.0 * (s->count - 1) + 0.5);
+
+    return s->lat[i] / 1000.0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: osfs_replay [-t] [-d dev] trace_file mount_dir\n"
+            "  -t      keep the original inter-op timing (default: maximum speed)\n"
+            "  -d dev  only replay ops from this superblock device number\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct op_stats stats[OP_MAX] = { 0 };
+    struct osfs_trace_rec *recs;
+    size_t count = 0, cap = 0, i, kept;
+    uint64_t start, elapsed, total_ops = 0, total_bytes = 0, max_len = 0;
+    long dev = -1;
+    int orig_timing = 0;
+    char *buf;
+    FILE *f;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "td:")) != -1) {
+        switch (opt) {
+        case 't':
+            orig_timing = 1;
+            break;
+        case 'd':
+            dev = strtol(optarg, NULL, 0);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (argc - optind != 2)
+        usage();
+    mount_dir = argv[optind + 1];
+
+    f = fopen(argv[optind], "rb");
+    if (!f) {
+        perror(argv[optind]);
+        return 1;
+    }
+    recs = NULL;
+    for (;;) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 65536;
+            recs = realloc(recs, cap * sizeof(*recs));
+            if (!recs) {
+                fprintf(stderr, "osfs_replay: out of memory\n");
+                return 1;
+            }
+        }
+        if (fread(&recs[count], sizeof(*recs), 1, f) != 1)
+            break;
+        count++;
+    }
+    fclose(f);
+
+    // Keep one superblock: the requested one, or the first one seen
+    for (i = 0, kept = 0; i < count; i++) {
+        if (recs[i].op == 0 || recs[i].op >= OP_MAX)
+            continue;
+        if (dev < 0)
+            dev = recs[i].dev;
+        if (recs[i].dev != (uint32_t)dev)
+            continue;
+        if ((recs[i].op == OSFS_TRACE_READ || recs[i].op == OSFS_TRACE_WRITE) && recs[i].len > max_len)
+            max_len = recs[i].len;
+        recs[kept++] = recs[i];
+    }
+    count = kept;
+    if (!count) {
+        fprintf(stderr, "osfs_replay: no records to replay\n");
+        return 1;
+    }
+
+    buf = xmalloc(max_len ? max_len : 1);
+    memset(buf, 0xa5, max_len);
+
+    plan(recs, count);
+    if (prep())
+        return 1;
+
+    start = now_ns();
+    for (i = 0; i < count; i++) {
+        const struct osfs_trace_rec *r = &recs[i];
+        uint64_t lat = 0;
+        ssize_t ret;
+
+        if (orig_timing) {
+            uint64_t due = start + (r->ts_ns - recs[0].ts_ns);
+            uint64_t now = now_ns();
+
+            if (due > now) {
+                struct timespec ts = {
+                    .tv_sec = (due - now) / 1000000000ull,
+                    .tv_nsec = (due - now) % 1000000000ull,
+                };
+                nanosleep(&ts, NULL);
+            }
+        }
+
+        ret = replay_one(r, buf, &lat);
+        stats_add(&stats[r->op], lat);
+        if (ret < 0)
+            stats[r->op].errors++;
+        else
+            stats[r->op].bytes += ret;
+    }
+    elapsed = now_ns() - start;
+
+    printf("%-8s %10s %8s %10s %10s %10s %10s %10s\n",
+           "op", "count", "errors", "p50(us)", "p90(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (i = 1; i < OP_MAX; i++) {
+        struct op_stats *s = &stats[i];
+
+        if (!s->count)
+            continue;
+        qsort(s->lat, s->count, sizeof(*s->lat), cmp_u64);
+        printf("%-8s %10zu %8" PRIu64 " %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               op_names[i], s->count, s->errors, pct(s, 50), pct(s, 90), pct(s, 99),
+               pct(s, 99.9), s->lat[s->count - 1] / 1000.0);
+        total_ops += s->count;
+        total_bytes += s->bytes;
+    }
+    printf("%" PRIu64 " ops in %.3f s: %.0f ops/s, %.1f MB/s\n", total_ops, elapsed / 1e9,
+           total_ops / (elapsed / 1e9), total_bytes / (elapsed / 1e9) / (1024 * 1024));
+
+    for (i = 0; i < nodes_cap; i++)
+        if (nodes[i] && nodes[i]->fd >= 0)
+            close(nodes[i]->fd);
+    return 0;
+}
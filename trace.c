@@ -0,0 +1,255 @@
+#include <linux/debugfs.h>
+#include <linux/jhash.h>
+#include <linux/jump_label.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include "osfs.h"
+
+static unsigned int trace_records = 65536;
+module_param(trace_records, uint, 0444);
+MODULE_PARM_DESC(trace_records, "Capacity of the op trace ring buffer, in records");
+
+DEFINE_STATIC_KEY_FALSE(osfs_trace_key);
+
+/*
+ * Single ring shared by all mounts. head and tail run freely and are masked
+ * on access; the ring is allocated on first enable and kept until unload.
+ * Records are dropped (and counted) when the reader falls behind.
+ */
+static struct osfs_trace_rec *trace_ring;
+static u32 trace_size;
+static u32 trace_head;
+static u32 trace_tail;
+static u64 trace_dropped;
+static bool trace_on;
+static DEFINE_SPINLOCK(trace_lock);
+static DEFINE_MUTEX(trace_enable_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(trace_wait);
+
+/**
+ * Function: osfs_trace_put
+ * Description: Appends one filled-in record to the trace ring, or counts it
+ *              as dropped when the reader has fallen behind.
+ */
+static void osfs_trace_put(const struct osfs_trace_rec *rec)
+{
+    osfs_spin_lock(&trace_lock, OSFS_LOCK_TRACE);
+    if (!trace_ring || trace_head - trace_tail >= trace_size) {
+        trace_dropped++;
+        spin_unlock(&trace_lock);
+        return;
+    }
+    trace_ring[trace_head & (trace_size - 1)] = *rec;
+    trace_head++;
+    spin_unlock(&trace_lock);
+
+    if (wq_has_sleeper(&trace_wait))
+        wake_up_interruptible(&trace_wait);
+}
+
+/**
+ * Function: __osfs_trace
+ * Description: Appends one record to the trace ring. Called through
+ *              osfs_trace() only while tracing is enabled.
+ * Inputs:
+ *   - sb: The superblock the op ran on.
+ *   - op: The operation code (enum osfs_trace_op).
+ *   - inode: The inode operated on, or NULL (e.g. failed lookup).
+ *   - dir: The parent directory for namespace ops, or NULL.
+ *   - name: The name for namespace ops, or NULL.
+ *   - offset, len: The file range for read/write.
+ *   - ret: The result of the operation.
+ * Returns:
+ *   - None.
+ */
+void __osfs_trace(struct super_block *sb, u16 op, struct inode *inode, struct inode *dir,
+                  const struct qstr *name, u64 offset, u32 len, int ret)
+{
+    struct osfs_trace_rec rec = {
+        .ts_ns = ktime_get_ns(),
+        .offset = offset,
+        .len = len,
+        .ino = inode ? inode->i_ino : 0,
+        .dir = dir ? dir->i_ino : 0,
+        .name_hash = name ? jhash(name->name, name->len, 0) : 0,
+        .ret = ret,
+        .dev = sb->s_dev,
+        .op = op,
+        .type = inode ? (inode->i_mode & S_IFMT) >> 12 : 0,
+    };
+
+    osfs_trace_put(&rec);
+}
+
+/**
+ * Function: __osfs_trace_rename
+ * Description: Appends a rename record. Called through osfs_trace_rename()
+ *              only while tracing is enabled.
+ * Inputs:
+ *   - old_dir, old_dentry: The source directory and entry.
+ *   - new_dir, new_dentry: The target directory and entry; a positive
+ *     target is the inode replaced, or exchanged with.
+ *   - flags: The RENAME_* flags.
+ *   - ret: The result of the operation.
+ * Returns:
+ *   - None.
+ */
+void __osfs_trace_rename(struct inode *old_dir, struct dentry *old_dentry, struct inode *new_dir,
+                         struct dentry *new_dentry, unsigned int flags, int ret)
+{
+    struct inode *inode = d_inode(old_dentry);
+    struct inode *target = d_inode(new_dentry);
+    struct osfs_trace_rec rec = {
+        .ts_ns = ktime_get_ns(),
+        .offset = (u64)(target ? target->i_ino : 0) << 32 | new_dir->i_ino,
+        .len = jhash(new_dentry->d_name.name, new_dentry->d_name.len, 0),
+        .ino = inode->i_ino,
+        .dir = old_dir->i_ino,
+        .name_hash = jhash(old_dentry->d_name.name, old_dentry->d_name.len, 0),
+        .ret = ret,
+        .dev = old_dir->i_sb->s_dev,
+        .op = OSFS_TRACE_RENAME,
+        .type = (inode->i_mode & S_IFMT) >> 12,
+        .flags = flags,
+    };
+
+    osfs_trace_put(&rec);
+}
+
+static bool osfs_trace_empty(void)
+{
+    return READ_ONCE(trace_head) == READ_ONCE(trace_tail);
+}
+
+/**
+ * Function: osfs_trace_read
+ * Description: Consumes whole records from the ring, trace_pipe style.
+ *              Blocks while the ring is empty unless opened O_NONBLOCK.
+ */
+static ssize_t osfs_trace_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct osfs_trace_rec rec;
+    size_t copied = 0;
+    int ret;
+
+    if (count < sizeof(rec))
+        return -EINVAL;
+
+    if (osfs_trace_empty()) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(trace_wait, !osfs_trace_empty());
+        if (ret)
+            return ret;
+    }
+
+    while (copied + sizeof(rec) <= count) {
+        osfs_spin_lock(&trace_lock, OSFS_LOCK_TRACE);
+        if (trace_head == trace_tail) {
+            spin_unlock(&trace_lock);
+            break;
+        }
+        rec = trace_ring[trace_tail & (trace_size - 1)];
+        trace_tail++;
+        spin_unlock(&trace_lock);
+
+        if (copy_to_user(buf + copied, &rec, sizeof(rec)))
+            return copied ? copied : -EFAULT;
+        copied += sizeof(rec);
+    }
+
+    return copied;
+}
+
+static const struct file_operations osfs_trace_fops = {
+    .owner = THIS_MODULE,
+    .read = osfs_trace_read,
+    .llseek = no_llseek,
+};
+
+static ssize_t osfs_trace_enable_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    char val[3] = { trace_on ? '1' : '0', '\n', '\0' };
+
+    return simple_read_from_buffer(buf, count, ppos, val, 2);
+}
+
+/**
+ * Function: osfs_trace_enable_write
+ * Description: Turns capture on or off. The ring is allocated on the first
+ *              enable, and the static key keeps the disabled cost at a nop.
+ */
+static ssize_t osfs_trace_enable_write(struct file *file, const char __user *buf,
+                                       size_t count, loff_t *ppos)
+{
+    struct osfs_trace_rec *ring;
+    bool enable;
+    int ret;
+
+    ret = kstrtobool_from_user(buf, count, &enable);
+    if (ret)
+        return ret;
+
+    osfs_mutex_lock(&trace_enable_mutex, OSFS_LOCK_TRACE);
+    if (enable && !trace_ring) {
+        u32 size = roundup_pow_of_two(max(trace_records, 64U));
+
+        ring = vmalloc(array_size(size, sizeof(*ring)));
+        if (!ring) {
+            mutex_unlock(&trace_enable_mutex);
+            return -ENOMEM;
+        }
+        osfs_spin_lock(&trace_lock, OSFS_LOCK_TRACE);
+        trace_ring = ring;
+        trace_size = size;
+        trace_head = trace_tail = 0;
+        spin_unlock(&trace_lock);
+    }
+    if (enable && !trace_on)
+        static_branch_enable(&osfs_trace_key);
+    else if (!enable && trace_on)
+        static_branch_disable(&osfs_trace_key);
+    trace_on = enable;
+    mutex_unlock(&trace_enable_mutex);
+
+    return count;
+}
+
+static const struct file_operations osfs_trace_enable_fops = {
+    .owner = THIS_MODULE,
+    .read = osfs_trace_enable_read,
+    .write = osfs_trace_enable_write,
+    .llseek = default_llseek,
+};
+
+/**
+ * Function: osfs_trace_init
+ * Description: Creates the trace control files under the osfs debugfs dir.
+ * Inputs:
+ *   - root: The osfs debugfs directory.
+ * Returns:
+ *   - None.
+ */
+void osfs_trace_init(struct dentry *root)
+{
+    debugfs_create_file("trace", 0400, root, NULL, &osfs_trace_fops);
+    debugfs_create_file("trace_enable", 0600, root, NULL, &osfs_trace_enable_fops);
+    debugfs_create_u64("trace_dropped", 0400, root, &trace_dropped);
+}
+
+/**
+ * Function: osfs_trace_exit
+ * Description: Stops capture and frees the ring. The debugfs files must
+ *              already be removed.
+ */
+void osfs_trace_exit(void)
+{
+    if (trace_on)
+        static_branch_disable(&osfs_trace_key);
+    trace_on = false;
+    vfree(trace_ring);
+    trace_ring = NULL;
+}
@@ -0,0 +1,274 @@
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include "osfs.h"
+
+/*
+ * Read-only layout views for user-space analyzers (see osfs_uapi.h). The
+ * header, block bitmap and FAT files map the live structures: their pages
+ * are handed out by a fault handler through vmalloc_to_page(), so reading
+ * them costs the filesystem nothing. The inode summary is compacted into a
+ * private buffer when the file is opened.
+ *
+ * An open view pins the mount's region through sb_info->refs; the pages a
+ * mapping has faulted in hold page references, so even a mapping kept past
+ * the teardown of the region only shows stale data.
+ */
+
+static struct dentry *osfs_view_root;
+
+/**
+ * Struct: osfs_view
+ * Description: An open view file.
+ */
+struct osfs_view {
+    struct osfs_sb_info *sb_info;
+    void *(*page_addr)(struct osfs_view *view, pgoff_t pgoff);
+    void *snapshot;             // inodes: the compacted summary
+    size_t size;                // Bytes of the view
+};
+
+static void *osfs_view_header_addr(struct osfs_view *view, pgoff_t pgoff)
+{
+    return pgoff ? NULL : view->sb_info->view;
+}
+
+static void *osfs_view_bitmap_addr(struct osfs_view *view, pgoff_t pgoff)
+{
+    return (void *)view->sb_info->block_bitmap + (pgoff << PAGE_SHIFT);
+}
+
+static void *osfs_view_fat_addr(struct osfs_view *view, pgoff_t pgoff)
+{
+    struct osfs_sb_info *sb_info = view->sb_info;
+    pgoff_t shared = PAGE_ALIGN((size_t)sb_info->shared_blocks * sizeof(uint32_t)) >> PAGE_SHIFT;
+    pgoff_t per_chunk = OSFS_CHUNK_FAT_SIZE >> PAGE_SHIFT;
+    pgoff_t c;
+
+    if (pgoff < shared)
+        return (void *)sb_info->fat + (pgoff << PAGE_SHIFT);
+    pgoff -= shared;
+    c = pgoff / per_chunk;
+    // Pairs with the release in osfs_pool_grow()
+    if (c >= smp_load_acquire(&sb_info->nr_chunks))
+        return NULL;
+    return (void *)sb_info->chunks[c]->fat + ((pgoff % per_chunk) << PAGE_SHIFT);
+}
+
+static void *osfs_view_snapshot_addr(struct osfs_view *view, pgoff_t pgoff)
+{
+    return view->snapshot + (pgoff << PAGE_SHIFT);
+}
+
+/**
+ * Function: osfs_view_snapshot_inodes
+ * Description: Compacts the inode table into struct osfs_view_inode
+ *              entries, indexed by inode number. Entries are read without
+ *              locking; each one may be mid-update, but no pointer is
+ *              followed.
+ */
+static int osfs_view_snapshot_inodes(struct osfs_view *view)
+{
+    struct osfs_sb_info *sb_info = view->sb_info;
+    struct osfs_inode *table = sb_info->inode_table;
+    struct osfs_view_inode *out;
+    uint32_t ino;
+
+    view->size = PAGE_ALIGN((size_t)sb_info->inode_count * sizeof(*out));
+    out = vmalloc_user(view->size);
+    if (!out)
+        return -ENOMEM;
+    for (ino = 1; ino < sb_info->inode_count; ino++) {
+        out[ino].mode = READ_ONCE(table[ino].i_mode);
+        if (!out[ino].mode)
+            continue;
+        out[ino].size = READ_ONCE(table[ino].i_size);
+        out[ino].blocks = READ_ONCE(table[ino].i_blocks);
+        out[ino].first_block = READ_ONCE(table[ino].i_block);
+        out[ino].links = READ_ONCE(table[ino].i_links_count);
+        out[ino].parent = READ_ONCE(table[ino].i_parent);
+        if (!(ino & 1023))
+            cond_resched();
+    }
+    view->snapshot = out;
+    return 0;
+}
+
+static int osfs_view_open(struct inode *inode, struct file *file)
+{
+    struct osfs_sb_info *sb_info = inode->i_private;
+    const char *name = file->f_path.dentry->d_name.name;
+    struct osfs_view *view;
+    int ret;
+
+    // Holds off osfs_view_unregister(), and with it the unmount, until the
+    // region is pinned
+    ret = debugfs_file_get(file->f_path.dentry);
+    if (ret)
+        return ret;
+
+    view = kzalloc(sizeof(*view), GFP_KERNEL);
+    if (!view) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    view->sb_info = sb_info;
+    if (!strcmp(name, "header")) {
+        view->page_addr = osfs_view_header_addr;
+        view->size = PAGE_SIZE;
+    } else if (!strcmp(name, "block_bitmap")) {
+        view->page_addr = osfs_view_bitmap_addr;
+        view->size = BITMAP_SIZE(sb_info->block_count) * sizeof(unsigned long);
+    } else if (!strcmp(name, "fat")) {
+        view->page_addr = osfs_view_fat_addr;
+        view->size = PAGE_ALIGN((size_t)sb_info->shared_blocks * sizeof(uint32_t)) +
+                     DIV_ROUND_UP((size_t)(sb_info->block_count - sb_info->shared_blocks),
+                                  OSFS_CHUNK_BLOCKS) * OSFS_CHUNK_FAT_SIZE;
+    } else {
+        view->page_addr = osfs_view_snapshot_addr;
+        ret = osfs_view_snapshot_inodes(view);
+        if (ret) {
+            kfree(view);
+            goto out;
+        }
+    }
+
+    refcount_inc(&sb_info->refs);
+    atomic_inc(&sb_info->view_users);
+    // A change that saw no users yet is not counted; wait for it to end
+    synchronize_rcu();
+    file->private_data = view;
+    ret = 0;
+out:
+    debugfs_file_put(file->f_path.dentry);
+    return ret;
+}
+
+static int osfs_view_release(struct inode *inode, struct file *file)
+{
+    struct osfs_view *view = file->private_data;
+
+    atomic_dec(&view->sb_info->view_users);
+    osfs_put_sb_info(view->sb_info);
+    vfree(view->snapshot);
+    kfree(view);
+    return 0;
+}
+
+/**
+ * Function: osfs_view_read
+ * Description: read(2) of a view, for tools that do not map it. Goes
+ *              through the same page lookup as the fault handler.
+ */
+static ssize_t osfs_view_read(struct file *file, char __user *buf, size_t len, loff_t *ppos)
+{
+    struct osfs_view *view = file->private_data;
+    loff_t pos = *ppos;
+    size_t done = 0;
+
+    while (done < len && pos < view->size) {
+        size_t offset = pos & (PAGE_SIZE - 1);
+        size_t n = min3(len - done, PAGE_SIZE - offset, (size_t)(view->size - pos));
+        void *page = view->page_addr(view, pos >> PAGE_SHIFT);
+
+        if (page ? copy_to_user(buf + done, page + offset, n) : clear_user(buf + done, n))
+            return done ? done : -EFAULT;
+        done += n;
+        pos += n;
+        cond_resched();
+    }
+    *ppos = pos;
+    return done;
+}
+
+static vm_fault_t osfs_view_fault(struct vm_fault *vmf)
+{
+    struct osfs_view *view = vmf->vma->vm_file->private_data;
+    void *addr;
+
+    if ((size_t)vmf->pgoff << PAGE_SHIFT >= view->size)
+        return VM_FAULT_SIGBUS;
+    addr = view->page_addr(view, vmf->pgoff);
+    if (!addr)
+        return VM_FAULT_SIGBUS;     // A chunk not backed yet
+    vmf->page = vmalloc_to_page(addr);
+    get_page(vmf->page);
+    return 0;
+}
+
+static const struct vm_operations_struct osfs_view_vm_ops = {
+    .fault = osfs_view_fault,
+};
+
+static int osfs_view_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE | VM_MAYEXEC);
+    vm_flags_set(vma, VM_DONTEXPAND);
+    vma->vm_ops = &osfs_view_vm_ops;
+    return 0;
+}
+
+static const struct file_operations osfs_view_fops = {
+    .owner = THIS_MODULE,
+    .open = osfs_view_open,
+    .release = osfs_view_release,
+    .read = osfs_view_read,
+    .mmap = osfs_view_mmap,
+    .llseek = default_llseek,
+};
+
+/**
+ * Function: osfs_view_fill_header
+ * Description: Initializes the header page of a new mount's region.
+ */
+void osfs_view_fill_header(struct osfs_sb_info *sb_info)
+{
+    struct osfs_view_header *h = sb_info->view;
+
+    h->magic = OSFS_MAGIC;
+    h->block_size = BLOCK_SIZE;
+    h->block_count = sb_info->block_count;
+    h->inode_count = sb_info->inode_count;
+    h->shared_blocks = sb_info->shared_blocks;
+    h->chunk_blocks = OSFS_CHUNK_BLOCKS;
+    h->fat_stride = OSFS_CHUNK_FAT_SIZE;
+    h->fat_chunk_offset = PAGE_ALIGN((size_t)sb_info->shared_blocks * sizeof(uint32_t));
+}
+
+/**
+ * Function: osfs_view_register
+ * Description: Creates the view files of a mount under
+ *              osfs/mounts/<major>:<minor>/.
+ */
+void osfs_view_register(struct osfs_sb_info *sb_info)
+{
+    struct super_block *sb = sb_info->sb;
+    char name[24];
+
+    snprintf(name, sizeof(name), "%u:%u", MAJOR(sb->s_dev), MINOR(sb->s_dev));
+    sb_info->debugfs = debugfs_create_dir(name, osfs_view_root);
+    // Not the full proxy: it does not forward mmap. osfs_view_open() takes
+    // the removal protection itself.
+    debugfs_create_file_unsafe("header", 0400, sb_info->debugfs, sb_info, &osfs_view_fops);
+    debugfs_create_file_unsafe("block_bitmap", 0400, sb_info->debugfs, sb_info, &osfs_view_fops);
+    debugfs_create_file_unsafe("fat", 0400, sb_info->debugfs, sb_info, &osfs_view_fops);
+    debugfs_create_file_unsafe("inodes", 0400, sb_info->debugfs, sb_info, &osfs_view_fops);
+}
+
+/**
+ * Function: osfs_view_unregister
+ * Description: Removes a mount's view files at unmount. Waits for opens in
+ *              progress; views already open keep the region pinned.
+ */
+void osfs_view_unregister(struct osfs_sb_info *sb_info)
+{
+    debugfs_remove_recursive(sb_info->debugfs);
+    sb_info->debugfs = NULL;
+}
+
+void osfs_view_init(struct dentry *root)
+{
+    osfs_view_root = debugfs_create_dir("mounts", root);
+}
@@ -0,0 +1,360 @@
+#include <linux/fs.h>
+#include <linux/xattr.h>
+#include "osfs.h"
+
+/*
+ * Extended attributes. Each inode carries a small inline area in its
+ * osfs_inode; attributes whose values fit OSFS_XATTR_INLINE_MAX_VALUE live
+ * there, larger ones spill into one data block per inode. Both areas use the
+ * same packed layout: variable-size entries kept sorted by (namespace,
+ * name), so a lookup stops at the first entry past the key. Getting a small
+ * attribute therefore reads only the osfs_inode.
+ */
+
+#define OSFS_XATTR_INDEX_USER     1
+#define OSFS_XATTR_INDEX_TRUSTED  2
+
+/**
+ * Struct: osfs_xattr_entry
+ * Description: One attribute; the name is followed by the value, and the
+ *              entry is padded to 4 bytes.
+ */
+struct osfs_xattr_entry {
+    uint8_t e_index;        // OSFS_XATTR_INDEX_*
+    uint8_t e_name_len;
+    uint16_t e_value_len;
+    char e_name[];
+};
+
+/**
+ * Struct: osfs_xattr_block
+ * Description: Header of the spill block.
+ */
+struct osfs_xattr_block {
+    uint32_t used;          // Bytes of entries following the header
+    uint8_t data[];
+};
+
+#define OSFS_XATTR_BLOCK_CAPACITY (BLOCK_SIZE - sizeof(struct osfs_xattr_block))
+
+/**
+ * Struct: osfs_xattr_area
+ * Description: One packed entry area (inline or block) being operated on.
+ */
+struct osfs_xattr_area {
+    uint8_t *data;
+    size_t used;
+    size_t capacity;
+};
+
+static inline size_t osfs_xattr_entry_size(size_t name_len, size_t value_len)
+{
+    return ALIGN(sizeof(struct osfs_xattr_entry) + name_len + value_len, 4);
+}
+
+static inline size_t osfs_xattr_size(const struct osfs_xattr_entry *e)
+{
+    return osfs_xattr_entry_size(e->e_name_len, e->e_value_len);
+}
+
+static int osfs_xattr_cmp(const struct osfs_xattr_entry *e, int index, const char *name, size_t name_len)
+{
+    int ret;
+
+    if (e->e_index != index)
+        return e->e_index - index;
+    ret = memcmp(e->e_name, name, min_t(size_t, e->e_name_len, name_len));
+    if (ret)
+        return ret;
+    return (int)e->e_name_len - (int)name_len;
+}
+
+/**
+ * Function: osfs_xattr_search
+ * Description: Finds an attribute in a sorted area.
+ * Inputs:
+ *   - area: The area to search.
+ *   - index, name, name_len: The attribute key.
+ *   - pos: Set to the offset of the match, or of the insertion point.
+ * Returns:
+ *   - The entry, or NULL if the key is not present.
+ */
+static struct osfs_xattr_entry *osfs_xattr_search(const struct osfs_xattr_area *area, int index,
+                                                  const char *name, size_t name_len, size_t *pos)
+{
+    size_t off = 0;
+
+    while (off < area->used) {
+        struct osfs_xattr_entry *e = (struct osfs_xattr_entry *)(area->data + off);
+        int cmp = osfs_xattr_cmp(e, index, name, name_len);
+
+        if (cmp >= 0) {
+            *pos = off;
+            return cmp == 0 ? e : NULL;
+        }
+        off += osfs_xattr_size(e);
+    }
+    *pos = off;
+    return NULL;
+}
+
+static void osfs_xattr_remove(struct osfs_xattr_area *area, size_t pos)
+{
+    size_t size = osfs_xattr_size((struct osfs_xattr_entry *)(area->data + pos));
+
+    memmove(area->data + pos, area->data + pos + size, area->used - pos - size);
+    area->used -= size;
+}
+
+static void osfs_xattr_insert(struct osfs_xattr_area *area, size_t pos, int index, const char *name,
+                              size_t name_len, const void *value, size_t value_len)
+{
+    size_t size = osfs_xattr_entry_size(name_len, value_len);
+    struct osfs_xattr_entry *e = (struct osfs_xattr_entry *)(area->data + pos);
+
+    memmove(area->data + pos + size, area->data + pos, area->used - pos);
+    memset(e, 0, size);
+    e->e_index = index;
+    e->e_name_len = name_len;
+    e->e_value_len = value_len;
+    memcpy(e->e_name, name, name_len);
+    memcpy(e->e_name + name_len, value, value_len);
+    area->used += size;
+}
+
+static void osfs_xattr_inline_area(struct osfs_inode *osfs_inode, struct osfs_xattr_area *area)
+{
+    area->data = osfs_inode->i_xattr_inline;
+    area->used = osfs_inode->i_xattr_inline_used;
+    area->capacity = OSFS_XATTR_INLINE_SIZE;
+}
+
+static struct osfs_xattr_block *osfs_xattr_block(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode)
+{
+    if (osfs_inode->i_xattr_block == OSFS_NO_BLOCK)
+        return NULL;
+    return osfs_block_addr(sb_info, osfs_inode->i_xattr_block);
+}
+
+static bool osfs_xattr_block_area(struct osfs_sb_info *sb_info, struct osfs_inode *osfs_inode,
+                                  struct osfs_xattr_area *area)
+{
+    struct osfs_xattr_block *block = osfs_xattr_block(sb_info, osfs_inode);
+
+    if (!block)
+        return false;
+    area->data = block->data;
+    area->used = block->used;
+    area->capacity = OSFS_XATTR_BLOCK_CAPACITY;
+    return true;
+}
+
+/**
+ * Function: osfs_xattr_get
+ * Description: Reads an attribute value, checking the inline area first.
+ * Returns:
+ *   - The value length (the value itself is copied when size is non-zero).
+ *   - -ENODATA if the attribute does not exist.
+ *   - -ERANGE if the buffer is too small.
+ */
+static int osfs_xattr_get(const struct xattr_handler *handler, struct dentry *unused,
+                          struct inode *inode, const char *name, void *buffer, size_t size)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    size_t name_len = strlen(name);
+    struct osfs_xattr_entry *e;
+    struct osfs_xattr_area area;
+    size_t pos;
+    int ret;
+
+    if (name_len > U8_MAX)
+        return -ERANGE;
+
+    osfs_inode_lock_shared(inode);
+    osfs_xattr_inline_area(osfs_inode, &area);
+    e = osfs_xattr_search(&area, handler->flags, name, name_len, &pos);
+    if (!e && osfs_xattr_block_area(sb_info, osfs_inode, &area))
+        e = osfs_xattr_search(&area, handler->flags, name, name_len, &pos);
+
+    if (!e) {
+        ret = -ENODATA;
+    } else if (size && size < e->e_value_len) {
+        ret = -ERANGE;
+    } else {
+        if (size)
+            memcpy(buffer, e->e_name + e->e_name_len, e->e_value_len);
+        ret = e->e_value_len;
+    }
+    inode_unlock_shared(inode);
+
+    return ret;
+}
+
+/**
+ * Function: osfs_xattr_set
+ * Description: Creates, replaces or (value == NULL) removes an attribute.
+ *              Values up to OSFS_XATTR_INLINE_MAX_VALUE go inline while space
+ *              allows; others go to the spill block, which is allocated on
+ *              demand and freed once empty. The VFS holds the inode lock.
+ * Returns:
+ *   - 0 on success.
+ *   - -EEXIST / -ENODATA for XATTR_CREATE / XATTR_REPLACE violations.
+ *   - -ERANGE if the name is too long.
+ *   - -ENOSPC if the attribute does not fit.
+ */
+static int osfs_xattr_set(const struct xattr_handler *handler, struct mnt_idmap *idmap,
+                          struct dentry *unused, struct inode *inode, const char *name,
+                          const void *value, size_t size, int flags)
+{
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    size_t name_len = strlen(name);
+    size_t need = osfs_xattr_entry_size(name_len, size);
+    struct osfs_xattr_area inl, blk, *old_area = NULL;
+    struct osfs_xattr_entry *old;
+    bool have_block;
+    size_t pos, old_size = 0;
+    uint32_t block_no;
+    int ret;
+
+    if (name_len > U8_MAX || size > U16_MAX)
+        return -ERANGE;
+
+    osfs_xattr_inline_area(osfs_inode, &inl);
+    have_block = osfs_xattr_block_area(sb_info, osfs_inode, &blk);
+
+    old = osfs_xattr_search(&inl, handler->flags, name, name_len, &pos);
+    if (old) {
+        old_area = &inl;
+    } else if (have_block) {
+        old = osfs_xattr_search(&blk, handler->flags, name, name_len, &pos);
+        if (old)
+            old_area = &blk;
+    }
+
+    if (old && (flags & XATTR_CREATE))
+        return -EEXIST;
+    if (!old && (flags & XATTR_REPLACE))
+        return -ENODATA;
+
+    if (value && size <= OSFS_XATTR_INLINE_MAX_VALUE &&
+        inl.used - (old_area == &inl ? osfs_xattr_size(old) : 0) + need <= inl.capacity) {
+        // Fits inline
+    } else if (value) {
+        if (need > OSFS_XATTR_BLOCK_CAPACITY)
+            return -ENOSPC;
+        if (have_block) {
+            old_size = old_area == &blk ? osfs_xattr_size(old) : 0;
+            if (blk.used - old_size + need > blk.capacity)
+                return -ENOSPC;
+        } else {
+            ret = osfs_alloc_data_block(sb_info, &block_no);
+            if (ret)
+                return ret;
+            osfs_inode->i_xattr_block = block_no;
+            osfs_xattr_block(sb_info, osfs_inode)->used = 0;
+            have_block = osfs_xattr_block_area(sb_info, osfs_inode, &blk);
+        }
+    }
+
+    // Drop the old copy, then insert the new one in sorted position
+    if (old)
+        osfs_xattr_remove(old_area, pos);
+    if (value) {
+        struct osfs_xattr_area *area = &inl;
+
+        if (size > OSFS_XATTR_INLINE_MAX_VALUE || inl.used + need > inl.capacity)
+            area = &blk;
+        osfs_xattr_search(area, handler->flags, name, name_len, &pos);
+        osfs_xattr_insert(area, pos, handler->flags, name, name_len, value, size);
+    }
+
+    osfs_inode->i_xattr_inline_used = inl.used;
+    if (have_block) {
+        if (blk.used) {
+            osfs_xattr_block(sb_info, osfs_inode)->used = blk.used;
+        } else {
+            osfs_free_data_block(sb_info, osfs_inode->i_xattr_block);
+            osfs_inode->i_xattr_block = OSFS_NO_BLOCK;
+        }
+    }
+
+    inode_set_ctime_current(inode);
+    inode_maybe_inc_iversion(inode, false);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+static size_t osfs_xattr_list_area(const struct osfs_xattr_area *area, struct dentry *dentry,
+                                   char *buffer, size_t size, size_t off, int *err)
+{
+    size_t pos = 0;
+
+    while (pos < area->used) {
+        struct osfs_xattr_entry *e = (struct osfs_xattr_entry *)(area->data + pos);
+        const char *prefix = e->e_index == OSFS_XATTR_INDEX_TRUSTED ? XATTR_TRUSTED_PREFIX : XATTR_USER_PREFIX;
+        size_t prefix_len = strlen(prefix);
+        size_t len = prefix_len + e->e_name_len + 1;
+
+        pos += osfs_xattr_size(e);
+        if (e->e_index == OSFS_XATTR_INDEX_TRUSTED && !capable(CAP_SYS_ADMIN))
+            continue;
+        if (buffer) {
+            if (off + len > size) {
+                *err = -ERANGE;
+                return off;
+            }
+            memcpy(buffer + off, prefix, prefix_len);
+            memcpy(buffer + off + prefix_len, e->e_name, e->e_name_len);
+            buffer[off + len - 1] = '\0';
+        }
+        off += len;
+    }
+    return off;
+}
+
+/**
+ * Function: osfs_listxattr
+ * Description: Lists attribute names as "prefix.name\0" strings.
+ * Returns:
+ *   - The size of the list, or -ERANGE if buffer is too small.
+ */
+ssize_t osfs_listxattr(struct dentry *dentry, char *buffer, size_t size)
+{
+    struct inode *inode = d_inode(dentry);
+    struct osfs_sb_info *sb_info = inode->i_sb->s_fs_info;
+    struct osfs_inode *osfs_inode = inode->i_private;
+    struct osfs_xattr_area area;
+    size_t off;
+    int err = 0;
+
+    osfs_inode_lock_shared(inode);
+    osfs_xattr_inline_area(osfs_inode, &area);
+    off = osfs_xattr_list_area(&area, dentry, buffer, size, 0, &err);
+    if (!err && osfs_xattr_block_area(sb_info, osfs_inode, &area))
+        off = osfs_xattr_list_area(&area, dentry, buffer, size, off, &err);
+    inode_unlock_shared(inode);
+
+    return err ? err : off;
+}
+
+static const struct xattr_handler osfs_xattr_user_handler = {
+    .prefix = XATTR_USER_PREFIX,
+    .flags = OSFS_XATTR_INDEX_USER,
+    .get = osfs_xattr_get,
+    .set = osfs_xattr_set,
+};
+
+static const struct xattr_handler osfs_xattr_trusted_handler = {
+    .prefix = XATTR_TRUSTED_PREFIX,
+    .flags = OSFS_XATTR_INDEX_TRUSTED,
+    .get = osfs_xattr_get,
+    .set = osfs_xattr_set,
+};
+
+const struct xattr_handler * const osfs_xattr_handlers[] = {
+    &osfs_xattr_user_handler,
+    &osfs_xattr_trusted_handler,
+    NULL,
+};